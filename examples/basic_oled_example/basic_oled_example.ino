@@ -82,6 +82,25 @@ unsigned long loopCounter;
 const unsigned long updateInterval = 1000;  // Update interval in milliseconds (1000 ms = 1 second)
 float frameRate = 0.0;
 
+/**
+* @brief Prints a lap time as seconds with three decimals
+*
+* @param lapTime The lap time, read once so the seconds and milliseconds match
+*/
+void displayLapTime(doves_time_t lapTime) {
+  unsigned long milliseconds = (unsigned long)(lapTime / (DOVES_TIME_UNITS_PER_SECOND / 1000));
+  display.print(milliseconds / 1000);
+  display.print(".");
+  // zero-pad the milliseconds, 1.005 would show as 1.5
+  if (milliseconds % 1000 < 100) {
+    display.print("0");
+  }
+  if (milliseconds % 1000 < 10) {
+    display.print("0");
+  }
+  display.print(milliseconds % 1000);
+}
+
 void setup() {
   #ifdef HAS_DEBUG
     Serial.begin(9600);
@@ -147,6 +166,7 @@ void gpsLoop() {
         if (gps->fixquality > 0) {
           float altitudeMeters = gps->altitude;
           float speedKnots = gps->speed;
+          lapTimer.updateHdop(gps->HDOP);
           lapTimer.loop(gps->latitudeDegrees, gps->longitudeDegrees, altitudeMeters, speedKnots);
         }
     }
@@ -345,9 +365,7 @@ void gpsLoop() {
     display.println();
 
     display.print("CLT: ");
-    display.print(lapTimer.getCurrentLapTime() / 1000);
-    display.print(".");
-    display.print(lapTimer.getCurrentLapTime() % 1000);
+    displayLapTime(lapTimer.getRunningLapTime());
     // display.print(", ");
     // display.print(lapTimer.lapTimer.getCurrentLapTime());
     
@@ -376,13 +394,9 @@ void gpsLoop() {
     display.print("B:");
     display.print(lapTimer.getBestLapNumber());
     display.print("-");
-    display.print(lapTimer.getBestLapTime() / 1000);
-    display.print(".");
-    display.print(lapTimer.getBestLapTime() % 1000);
+    displayLapTime(lapTimer.getBestLapTime());
     display.print(" L: ");
-    display.print(lapTimer.getLastLapTime() / 1000);
-    display.print(".");
-    display.print(lapTimer.getLastLapTime() % 1000);
+    displayLapTime(lapTimer.getLastLapTime());
 
     // display.print("lapStart: ");
     // display.println(lapTimer.getCurrentLapStartTime());
@@ -149,12 +149,39 @@ void setup() {
   debugln(F("GPS Lap Timer Started"));
 }
 
+/**
+ * @brief Prints the crossing decisions recorded by the lap timer since the last call
+ *
+ * The lap timer only records them in a small binary ring, printing them here instead keeps
+ * slow serial output out of its loop() and away from the timing of the fixes.
+ */
+void printTraceEvents() {
+  static const char *names[] = {"?", "threshold enter", "buffer insert", "pair chosen", "crossing", "no crossing", "moving away"};
+  dovesTraceEvent event;
+  while (lapTimer.readTraceEvent(event)) {
+    debug(event.time);
+    debug(" line ");
+    debug(event.line);
+    debug(" ");
+    debug(names[event.type <= DOVES_TRACE_MOVING_AWAY ? event.type : 0]);
+    debug(" index ");
+    debug(event.index);
+    debug(" value ");
+    debugln(event.value);
+  }
+  if (lapTimer.getTraceEventsDropped() > 0) {
+    debug("trace events dropped: ");
+    debugln(lapTimer.getTraceEventsDropped());
+  }
+}
+
 bool done = false;
 unsigned long lastLapTime = -1;
 void loop() {
   if (last_processed_line >= num_gps_logs - 1 ) {
     if (!done) {
       done = true;
+      printTraceEvents();
       debugln("~~~~~~~~Finished~~~~~~~~");
     }
     return;
@@ -173,6 +200,7 @@ void loop() {
       debug(lastLapTime / 1000);
       debug(".");
       debugln(lastLapTime % 1000);
+      printTraceEvents();
     }
 
     // if (lapTimer.getRaceStarted()) {
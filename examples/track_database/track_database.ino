@@ -0,0 +1,116 @@
+/**
+ * Picks the track and its timing lines out of a track database on the first GPS fix,
+ * instead of hard-coding crossing points into the sketch.
+ *
+ * track_db.h was generated from extras/trackdb/tracks.json with
+ *   python3 extras/trackdb/build_trackdb.py extras/trackdb/tracks.json examples/track_database/track_db.h
+ * The same script can write a .bin for an SD card, see DovesTrackDatabase::begin(reader, context).
+ *
+ * Assumes an adafruit compatible GPS, like the basic oled example, serial output only.
+ */
+
+// reminder: this example pauses code until terminal connected
+#define HAS_DEBUG
+#define DEBUG_SERIAL Serial
+
+#ifdef HAS_DEBUG
+  #define debugln DEBUG_SERIAL.println
+  #define debug DEBUG_SERIAL.print
+#else
+  void dummy_debug(...) {}
+  #define debug dummy_debug
+  #define debugln dummy_debug
+#endif
+
+#define GPS_SERIAL Serial1
+#include <Adafruit_GPS.h>
+Adafruit_GPS* gps = NULL;
+
+#include <DovesLapTimer.h>
+#include <DovesTrackDatabase.h>
+#include "track_db.h"
+
+// which layout of the venue to run, most venues only have one
+#define LAYOUT_INDEX 0
+
+double crossingThresholdMeters = 7.0;
+DovesLapTimer lapTimer(crossingThresholdMeters);
+DovesTrackDatabase trackDatabase;
+bool trackSelected = false;
+
+/**
+ * @brief Returns the GPS time since midnight in milliseconds
+ *
+ * @return unsigned long The time since midnight in milliseconds
+ */
+unsigned long getGpsTimeInMilliseconds() {
+  unsigned long timeInMillis = 0;
+  timeInMillis += gps->hour * 3600000ULL;   // Convert hours to milliseconds
+  timeInMillis += gps->minute * 60000ULL;   // Convert minutes to milliseconds
+  timeInMillis += gps->seconds * 1000ULL;   // Convert seconds to milliseconds
+  timeInMillis += gps->milliseconds;        // Add the milliseconds part
+  return timeInMillis;
+}
+
+/**
+ * @brief Looks up the track under the driver and loads its timing lines into the lap timer
+ */
+void selectTrack(double lat, double lng) {
+  int trackIndex = trackDatabase.findTrack(lat, lng);
+  if (trackIndex < 0) {
+    return;
+  }
+
+  dovesTrackInfo track;
+  dovesLayoutInfo layout;
+  trackDatabase.getTrack(trackIndex, track);
+  trackDatabase.getLayout(trackIndex, LAYOUT_INDEX, layout);
+  trackDatabase.loadLayout(trackIndex, LAYOUT_INDEX, lapTimer);
+  lapTimer.reset();
+  trackSelected = true;
+
+  debug("Track: ");
+  debug(track.name);
+  debug(" | Layout: ");
+  debugln(layout.name);
+}
+
+void setup() {
+  #ifdef HAS_DEBUG
+    Serial.begin(9600);
+    while (!Serial);
+  #endif
+
+  gps = new Adafruit_GPS(&GPS_SERIAL);
+  gps->begin(9600);
+
+  if (!trackDatabase.begin(doves_track_db, sizeof(doves_track_db))) {
+    debugln("Invalid track database");
+  }
+  debug("Tracks in database: ");
+  debugln(trackDatabase.getTrackCount());
+}
+
+unsigned long lastLapTime = 0;
+void loop() {
+  char c = gps->read();
+  if (gps->newNMEAreceived() && gps->parse(gps->lastNMEA())) {
+    if (gps->fixquality > 0) {
+      if (!trackSelected) {
+        selectTrack(gps->latitudeDegrees, gps->longitudeDegrees);
+      }
+      // the fix carries its own time, no separate updateCurrentTime() needed
+      lapTimer.loop(gps->latitudeDegrees, gps->longitudeDegrees, gps->altitude, gps->speed, getGpsTimeInMilliseconds());
+    } else if (gps->satellites >= 1) {
+      lapTimer.updateCurrentTime(getGpsTimeInMilliseconds());
+    }
+  }
+
+  if (lastLapTime != lapTimer.getLastLapTime()) {
+    lastLapTime = lapTimer.getLastLapTime();
+    debug("LastLapTime: ");
+    debug(lastLapTime / 1000);
+    debug(".");
+    debugln(lastLapTime % 1000);
+  }
+}
@@ -0,0 +1,17 @@
+// Generated by extras/trackdb/build_trackdb.py, do not edit
+#ifndef _DOVES_TRACK_DB_H
+#define _DOVES_TRACK_DB_H
+const uint8_t doves_track_db[] = {
+  0x44, 0x4c, 0x54, 0x44, 0x01, 0x00, 0x01, 0x00, 0x10, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00,
+  0x8a, 0x01, 0xd9, 0x01, 0x00, 0x00, 0x00, 0x00, 0x55, 0x5b, 0xef, 0x10, 0x39, 0x72, 0x7e, 0xcf,
+  0xdc, 0x05, 0x02, 0x00, 0x40, 0x00, 0x00, 0x00, 0x4f, 0x72, 0x6c, 0x61, 0x6e, 0x64, 0x6f, 0x20,
+  0x4b, 0x61, 0x72, 0x74, 0x20, 0x43, 0x65, 0x6e, 0x74, 0x65, 0x72, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x4e, 0x6f, 0x72, 0x6d, 0x61, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00,
+  0x4c, 0x6f, 0x6e, 0x67, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x94, 0x00, 0x00, 0x00,
+  0x08, 0x70, 0xef, 0x10, 0xeb, 0x74, 0x7e, 0xcf, 0x92, 0x6f, 0xef, 0x10, 0xe8, 0x70, 0x7e, 0xcf,
+  0x00, 0x00, 0x00, 0x00, 0x08, 0x70, 0xef, 0x10, 0xeb, 0x74, 0x7e, 0xcf, 0x92, 0x6f, 0xef, 0x10,
+  0xe8, 0x70, 0x7e, 0xcf, 0x00, 0x00, 0x00, 0x00,
+};
+#endif
@@ -69,6 +69,29 @@ bool testNotCrossingNextToLine6();
 bool testInCrossingThreshold();
 bool testRaceStarted();
 bool testLapDetection();
+bool testSplitLineDetection();
+bool testPointToPoint();
+bool testPitLane();
+bool testCrossingDirection();
+bool testLapOverMidnight();
+bool testRunningLapTime();
+bool testPpsDiscipline();
+#if DOVES_DELTA_MAX_SAMPLES > 0
+bool testDeltaToBest();
+bool testPositionDeltaToBest();
+bool testPredictedLapTime();
+#endif
+bool testOptimalLap();
+bool testSectorsAfterClearingLines();
+bool testSectorsAfterMissedSplit();
+bool testLapHistory();
+bool testOdometerGate();
+#if DOVES_TRACE_RING_SIZE > 0
+bool testTraceRing();
+#endif
+#ifdef DOVES_PROFILE
+bool testStageProfile();
+#endif
 #ifdef DOVES_UNIT_TEST
 bool testCatmullRom1();
 bool testCatmullRom2();
@@ -85,6 +108,9 @@ bool testInterpolationLinear1();
 bool testInterpolationLinear2();
 bool testInterpolationLinear3();
 bool testInterpolationLinear4();
+bool testInterpolationOdometerWrap();
+bool testLapStatistics();
+bool testLapHistoryLongStages();
 #endif
 
 Test tests[] = {
@@ -123,10 +149,40 @@ Test tests[] = {
   {testInterpolationLinear2, "testInterpolationLinear2"},
   {testInterpolationLinear3, "testInterpolationLinear3"},
   {testInterpolationLinear4, "testInterpolationLinear4"},
+  {testInterpolationOdometerWrap, "testInterpolationOdometerWrap"},
+  {testLapStatistics, "testLapStatistics"},
+  #if DOVES_LAP_HISTORY_SIZE > 0
+  {testLapHistoryLongStages, "testLapHistoryLongStages"},
+  #endif
   #endif
 
   {testRaceStarted, "testRaceStarted"},
-  {testLapDetection, "testLapDetection"}
+  {testLapDetection, "testLapDetection"},
+  {testSplitLineDetection, "testSplitLineDetection"},
+  {testPointToPoint, "testPointToPoint"},
+  {testPitLane, "testPitLane"},
+  {testCrossingDirection, "testCrossingDirection"},
+  {testLapOverMidnight, "testLapOverMidnight"},
+  {testRunningLapTime, "testRunningLapTime"},
+  {testPpsDiscipline, "testPpsDiscipline"},
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  {testDeltaToBest, "testDeltaToBest"},
+  {testPositionDeltaToBest, "testPositionDeltaToBest"},
+  {testPredictedLapTime, "testPredictedLapTime"},
+  #endif
+  {testOptimalLap, "testOptimalLap"},
+  {testSectorsAfterClearingLines, "testSectorsAfterClearingLines"},
+  {testSectorsAfterMissedSplit, "testSectorsAfterMissedSplit"},
+  #if DOVES_LAP_HISTORY_SIZE > 0
+  {testLapHistory, "testLapHistory"},
+  #endif
+  {testOdometerGate, "testOdometerGate"},
+  #if DOVES_TRACE_RING_SIZE > 0
+  {testTraceRing, "testTraceRing"},
+  #endif
+  #ifdef DOVES_PROFILE
+  {testStageProfile, "testStageProfile"},
+  #endif
   /*
     TODO:
       catmullrom / interpolationWeight
@@ -211,13 +267,8 @@ unsigned long currentMillis;
 int failedTests = 0;
 GpsCords finishLineMidPoint;
 
-void setup() {
-  #if defined(HAS_DEBUG) || defined(DOVES_LAP_TIMER_DEBUG)
-    DEBUG_SERIAL.begin(9600);
-    while (!DEBUG_SERIAL);
-  #endif
-
-  debugln("Lap Timer Unit Tests Started\n");
+// generates the start/finish line the tests cross, call once before running any test
+void setupTestLine() {
   GpsCords crossingPointA;
   crossingPointA.lat = crossingPointALat;
   crossingPointA.lng = crossingPointALng;
@@ -233,16 +284,32 @@ void setup() {
   crossingPointALng = crossingPointA.lng;
   crossingPointBLat = crossingPointB.lat;
   crossingPointBLng = crossingPointB.lng;
+}
+
+// runs a single test on a freshly re-initialized lap timer
+bool runTest(const Test &test) {
+  lapTimer.clearTimingLines();
+  lapTimer.setCrossingDirection(DOVES_DIRECTION_ANY);
+  lapTimer.setStartFinishLine(crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
+  lapTimer.reset();
+  lapTimer.updateCurrentTime(millis());
+  lapTimer.forceCatmullRomInterpolation();
+
+  return test.function();
+}
+
+void setup() {
+  #if defined(HAS_DEBUG) || defined(DOVES_LAP_TIMER_DEBUG)
+    DEBUG_SERIAL.begin(9600);
+    while (!DEBUG_SERIAL);
+  #endif
+
+  debugln("Lap Timer Unit Tests Started\n");
+  setupTestLine();
 
   for (int i = 0; i < (sizeof(tests) / sizeof(tests[0])); i++) {
     unsigned long testStart = micros();
-    // re-initialize before each test
-    lapTimer.setStartFinishLine(crossingPointALat, crossingPointALng, crossingPointB.lat, crossingPointB.lng);
-    lapTimer.reset();
-    lapTimer.updateCurrentTime(millis());
-    lapTimer.forceCatmullRomInterpolation();
-
-    bool result = tests[i].function();
+    bool result = runTest(tests[i]);
     if (!result) {
       debug("Test failed: ");
       debugln(tests[i].name);
@@ -392,10 +459,12 @@ bool testPointLineSegmentDistance4() {
 }
 
 
-// automates some of the loop for testing purposes
+// automates some of the loop for testing purposes, emulating a 10hz gps reporting time since midnight
+const doves_time_t TIME_PER_DAY = (doves_time_t)86400 * DOVES_TIME_UNITS_PER_SECOND;
+doves_time_t simulatedTime = 0;
 void lapTimerTestLoop(GpsCords cords, float altitudeMeters, float speedKnots) {
-  lapTimer.updateCurrentTime(millis());
-  lapTimer.loop(cords.lat, cords.lng, altitudeMeters, speedKnots);
+  simulatedTime += DOVES_TIME_UNITS_PER_SECOND / 10;
+  lapTimer.loop(cords.lat, cords.lng, altitudeMeters, speedKnots, simulatedTime % TIME_PER_DAY);
 }
 // 0 = north | 1 = east | 2 = south | 3 = west
 void incrementTimerLoop(GpsCords &cords, double metersPerMove, int moveCount, int direction = 0, float speedKnots = 10, float altitudeMeters = 50) {
@@ -504,6 +573,11 @@ bool testRaceStarted() {
   if (!lapTimer.getRaceStarted()) {
     return false;
   }
+  // the lap started on the line, part way along the odometer
+  float lapStart = lapTimer.getCurrentLapOdometerStart();
+  if (lapStart <= 0 || lapStart > lapTimer.getTotalDistanceTraveled() || fabs(lapStart + lapTimer.getCurrentLapDistance() - lapTimer.getTotalDistanceTraveled()) > 0.01) {
+    return false;
+  }
 
   return true;
 }
@@ -539,6 +613,531 @@ bool testLapDetection() {
   return true;
 }
 
+bool testSplitLineDetection() {
+  // split line 60 meters north of the start/finish, same width
+  GpsCords splitPointA = moveNorth({crossingPointALat, crossingPointALng}, 60);
+  GpsCords splitPointB = moveNorth({crossingPointBLat, crossingPointBLng}, 60);
+  int splitLine = lapTimer.addTimingLine(splitPointA.lat, splitPointA.lng, splitPointB.lat, splitPointB.lng);
+  if (splitLine != 1 || lapTimer.getTimingLineCount() != 2) {
+    return false;
+  }
+
+  // drive north through start/finish and then through the split
+  GpsCords testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 80);
+
+  if (!lapTimer.getRaceStarted() || lapTimer.getLaps() != 0) {
+    return false;
+  }
+  if (lapTimer.getLastLineCrossed() != splitLine || lapTimer.getLineCrossingTime(splitLine) < lapTimer.getCurrentLapStartTime()) {
+    return false;
+  }
+  return true;
+}
+
+bool testPointToPoint() {
+  // start line where the start/finish usually is, finish line 60 meters north
+  GpsCords finishPointA = moveNorth({crossingPointALat, crossingPointALng}, 60);
+  GpsCords finishPointB = moveNorth({crossingPointBLat, crossingPointBLng}, 60);
+  lapTimer.clearTimingLines();
+  lapTimer.setStartLine(crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
+  lapTimer.setFinishLine(finishPointA.lat, finishPointA.lng, finishPointB.lat, finishPointB.lng);
+  lapTimer.reset();
+
+  // finish line is ignored until the run has started
+  GpsCords testPoint = moveSouth(finishPointA, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getRaceStarted() || lapTimer.getLaps() != 0) {
+    return false;
+  }
+
+  // now do the actual run, start to finish
+  testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 30);
+  if (!lapTimer.getRaceStarted()) {
+    return false;
+  }
+  incrementTimerLoop(testPoint, 1, 50);
+  if (lapTimer.getRaceStarted() || lapTimer.getLaps() != 1 || lapTimer.getCurrentLapTime() != 0) {
+    return false;
+  }
+  return true;
+}
+
+bool testPitLane() {
+  // pit entry 30 meters north of the start/finish, pit exit 60 meters north
+  GpsCords pitEntryA = moveNorth({crossingPointALat, crossingPointALng}, 30);
+  GpsCords pitEntryB = moveNorth({crossingPointBLat, crossingPointBLng}, 30);
+  GpsCords pitExitA = moveNorth({crossingPointALat, crossingPointALng}, 60);
+  GpsCords pitExitB = moveNorth({crossingPointBLat, crossingPointBLng}, 60);
+  lapTimer.setPitEntryLine(pitEntryA.lat, pitEntryA.lng, pitEntryB.lat, pitEntryB.lng);
+  lapTimer.setPitExitLine(pitExitA.lat, pitExitA.lng, pitExitB.lat, pitExitB.lng);
+
+  // start the race and drive into the pit lane
+  GpsCords testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 50);
+  if (!lapTimer.getRaceStarted() || !lapTimer.getInPitLane() || lapTimer.getPitCount() != 1) {
+    return false;
+  }
+
+  // leave the pit lane, then complete the lap
+  incrementTimerLoop(testPoint, 1, 30);
+  if (lapTimer.getInPitLane() || lapTimer.getLastPitTime() == 0) {
+    return false;
+  }
+  testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 1 || lapTimer.getLastLapFlags() != (DOVES_LAP_IN_LAP | DOVES_LAP_OUT_LAP) || lapTimer.getCurrentLapFlags() != 0) {
+    return false;
+  }
+  return true;
+}
+
+bool testCrossingDirection() {
+  // only count crossings going north
+  GpsCords northPoint = moveNorth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  int northSide = lapTimer.pointOnSideOfLine(northPoint.lat, northPoint.lng, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
+  lapTimer.setCrossingDirection((crossingDirection)northSide);
+
+  // driving south only buffers for a moment after passing the line, then gives up
+  GpsCords testPoint = northPoint;
+  lapTimerTestLoop(testPoint, 50, 5);
+  int bufferedFixes = 0;
+  for (int i = 0; i < 20; i++) {
+    incrementTimerLoop(testPoint, 1, 1, 2);
+    if (lapTimer.getCrossing()) {
+      bufferedFixes++;
+    }
+  }
+  if (lapTimer.getRaceStarted() || bufferedFixes > 3) {
+    return false;
+  }
+
+  // driving north does
+  testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (!lapTimer.getRaceStarted()) {
+    return false;
+  }
+  return true;
+}
+
+bool testLapOverMidnight() {
+  // start the race a second before midnight
+  simulatedTime = TIME_PER_DAY - DOVES_TIME_UNITS_PER_SECOND;
+  GpsCords testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 16);
+
+  // finish the lap after midnight, one fix per meter
+  testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 16);
+
+  // lap is 17 fixes at 10hz
+  if (lapTimer.getLaps() != 1 || lapTimer.getLastLapTime() < DOVES_TIME_UNITS_PER_SECOND * 16 / 10 || lapTimer.getLastLapTime() > DOVES_TIME_UNITS_PER_SECOND * 18 / 10) {
+    return false;
+  }
+  if (lapTimer.getSessionTime() < TIME_PER_DAY) {
+    return false;
+  }
+  return true;
+}
+
+bool testRunningLapTime() {
+  // start the race
+  GpsCords testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 16);
+  if (!lapTimer.getRaceStarted()) {
+    return false;
+  }
+
+  // the running lap time starts at the last fix and keeps advancing without new fixes
+  doves_time_t lapTimeAtFix = lapTimer.getCurrentLapTime();
+  doves_time_t runningLapTime = lapTimer.getRunningLapTime();
+  if (runningLapTime < lapTimeAtFix) {
+    return false;
+  }
+  delay(20);
+  doves_time_t laterRunningLapTime = lapTimer.getRunningLapTime();
+  if (laterRunningLapTime < runningLapTime + DOVES_TIME_UNITS_PER_SECOND / 100 || lapTimer.getCurrentLapTime() != lapTimeAtFix) {
+    return false;
+  }
+  return true;
+}
+
+bool testPpsDiscipline() {
+  // two synthetic PPS edges 1000050us apart, a local crystal running 50ppm fast
+  unsigned long now = micros();
+  unsigned long firstEdge = now - 1300000;
+  unsigned long secondEdge = firstEdge + 1000050;
+  lapTimer.ppsEdge(firstEdge);
+  lapTimer.ppsEdge(secondEdge);
+
+  // a sentence for 100ms into the second arrives ~300ms after its edge
+  doves_time_t gpsSecondStart = (simulatedTime % TIME_PER_DAY / DOVES_TIME_UNITS_PER_SECOND + 5) * DOVES_TIME_UNITS_PER_SECOND;
+  lapTimer.updateCurrentTime(gpsSecondStart + DOVES_TIME_UNITS_PER_SECOND / 10);
+  // earlier tests may have rolled the session over midnight
+  doves_time_t secondStart = (doves_time_t)lapTimer.getSessionTime() - DOVES_TIME_UNITS_PER_SECOND / 10;
+  if (lapTimer.getGpsTimeAt(secondEdge) != secondStart || lapTimer.getGpsTimeAt(secondEdge + 500025) != secondStart + DOVES_TIME_UNITS_PER_SECOND / 2) {
+    return false;
+  }
+
+  // a late sentence for 900ms into that second arrives just after the next edge
+  unsigned long thirdEdge = micros() - 50000;
+  lapTimer.ppsEdge(thirdEdge);
+  lapTimer.updateCurrentTime(gpsSecondStart + DOVES_TIME_UNITS_PER_SECOND * 9 / 10);
+  if (lapTimer.getGpsTimeAt(thirdEdge) != secondStart + DOVES_TIME_UNITS_PER_SECOND) {
+    return false;
+  }
+  return true;
+}
+
+#if DOVES_DELTA_MAX_SAMPLES > 0
+bool testDeltaToBest() {
+  // start the race and drive 32 meters past the line at 1 meter per fix, then jump back south of the line in one fix
+  GpsCords start = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  GpsCords testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 40);
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  if (lapTimer.getDeltaToBest() != 0) {
+    return false;
+  }
+  // finish the lap and drive 12 meters into the next one at the same speed
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 1) {
+    return false;
+  }
+
+  // then 12 meters at half the speed, reaching 24 meters 1.2 seconds later than on the best lap
+  incrementTimerLoop(testPoint, 0.5, 24);
+  long delta = lapTimer.getDeltaToBest();
+  if (delta < DOVES_TIME_UNITS_PER_SECOND || delta > DOVES_TIME_UNITS_PER_SECOND * 14 / 10) {
+    return false;
+  }
+  return true;
+}
+
+bool testPositionDeltaToBest() {
+  // same best lap as testDeltaToBest
+  GpsCords start = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  GpsCords testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 40);
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 1) {
+    return false;
+  }
+
+  // weave 1 meter sideways every fix while keeping the same pace up the track, the odometer runs 40% ahead
+  for (int i = 0; i < 12; i++) {
+    testPoint = moveNorth(testPoint, 1);
+    testPoint = i % 2 == 0 ? moveEast(testPoint, 1) : moveWest(testPoint, 1);
+    lapTimerTestLoop(testPoint, 50, 5);
+  }
+  long positionDelta = lapTimer.getPositionDeltaToBest();
+  if (positionDelta < -(long)DOVES_TIME_UNITS_PER_SECOND / 10 || positionDelta > (long)DOVES_TIME_UNITS_PER_SECOND / 10) {
+    return false;
+  }
+  if (lapTimer.getDeltaToBest() > -(long)DOVES_TIME_UNITS_PER_SECOND / 4) {
+    return false;
+  }
+  return true;
+}
+
+bool testPredictedLapTime() {
+  // same best lap as testDeltaToBest
+  GpsCords start = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  GpsCords testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 40);
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  if (lapTimer.getPredictedLapTime() != 0) {
+    return false;
+  }
+  incrementTimerLoop(testPoint, 1, 20);
+
+  // at the same pace the prediction is the best lap, 12 meters at half the speed lose 1.2 seconds
+  long onPace = (long)(lapTimer.getPredictedLapTime() - lapTimer.getBestLapTime());
+  incrementTimerLoop(testPoint, 0.5, 24);
+  long offPace = (long)(lapTimer.getPredictedLapTime() - lapTimer.getBestLapTime());
+  if (onPace < -(long)DOVES_TIME_UNITS_PER_SECOND / 10 || onPace > (long)DOVES_TIME_UNITS_PER_SECOND / 10) {
+    return false;
+  }
+  if (offPace < (long)DOVES_TIME_UNITS_PER_SECOND || offPace > (long)DOVES_TIME_UNITS_PER_SECOND * 14 / 10) {
+    return false;
+  }
+  return true;
+}
+#endif
+
+bool testOptimalLap() {
+  // split line 30 meters north of the start/finish
+  GpsCords splitPointA = moveNorth({crossingPointALat, crossingPointALng}, 30);
+  GpsCords splitPointB = moveNorth({crossingPointBLat, crossingPointBLng}, 30);
+  int splitLine = lapTimer.addTimingLine(splitPointA.lat, splitPointA.lng, splitPointB.lat, splitPointB.lng);
+
+  // lap 1: 3.0s to the split, 1.1s back to the line
+  GpsCords start = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  GpsCords testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 40);
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 1 || lapTimer.getOptimalLapTime() != lapTimer.getLastLapTime() || lapTimer.getRollingBestLapTime() != lapTimer.getLastLapTime()) {
+    return false;
+  }
+
+  // lap 2: faster to the split (2.1s), slower back (1.4s)
+  incrementTimerLoop(testPoint, 2, 14);
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 2) {
+    return false;
+  }
+
+  // optimal and rolling best (lap 1 sector 2 + lap 2 sector 1) are both 3.2s, under the best lap of 3.5s
+  doves_time_t expected = DOVES_TIME_UNITS_PER_SECOND * 32 / 10;
+  doves_time_t tolerance = DOVES_TIME_UNITS_PER_SECOND * 15 / 100;
+  if (lapTimer.getOptimalLapTime() < expected - tolerance || lapTimer.getOptimalLapTime() > expected + tolerance) {
+    return false;
+  }
+  if (lapTimer.getRollingBestLapTime() != lapTimer.getOptimalLapTime() || lapTimer.getBestLapTime() <= lapTimer.getOptimalLapTime()) {
+    return false;
+  }
+  if (lapTimer.getBestSectorTime(splitLine) + lapTimer.getBestSectorTime(0) != lapTimer.getOptimalLapTime()) {
+    return false;
+  }
+  return true;
+}
+
+// lines replaced mid-lap, the first split crossed after has no sector to close
+bool testSectorsAfterClearingLines() {
+  GpsCords splitPointA = moveNorth({crossingPointALat, crossingPointALng}, 30);
+  GpsCords splitPointB = moveNorth({crossingPointBLat, crossingPointBLng}, 30);
+  GpsCords start = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  GpsCords testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+
+  lapTimer.clearTimingLines();
+  lapTimer.setStartFinishLine(crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
+  int splitLine = lapTimer.addTimingLine(splitPointA.lat, splitPointA.lng, splitPointB.lat, splitPointB.lng);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getBestSectorTime(splitLine) != 0) {
+    return false;
+  }
+
+  // finish lap 1, then a full lap 2 over both sectors
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 40);
+  if (lapTimer.getOptimalLapTime() != 0 || lapTimer.getRollingBestLapTime() != 0) {
+    return false;
+  }
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 2 || lapTimer.getBestSectorTime(splitLine) == 0) {
+    return false;
+  }
+  return lapTimer.getOptimalLapTime() == lapTimer.getBestSectorTime(splitLine) + lapTimer.getBestSectorTime(0)
+    && lapTimer.getRollingBestLapTime() == lapTimer.getLastLapTime();
+}
+
+// a dropout over the second split on lap 1, the full laps after it relearn the sectors
+bool testSectorsAfterMissedSplit() {
+  int splitLines[2];
+  for (int i = 0; i < 2; i++) {
+    GpsCords splitPointA = moveNorth({crossingPointALat, crossingPointALng}, 30 * (i + 1));
+    GpsCords splitPointB = moveNorth({crossingPointBLat, crossingPointBLng}, 30 * (i + 1));
+    splitLines[i] = lapTimer.addTimingLine(splitPointA.lat, splitPointA.lng, splitPointB.lat, splitPointB.lng);
+  }
+
+  GpsCords start = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  GpsCords testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 48);
+  // no fixes from 40 to 69 meters
+  testPoint = moveNorth(testPoint, 29);
+  simulatedTime += 29 * DOVES_TIME_UNITS_PER_SECOND / 10;
+  incrementTimerLoop(testPoint, 1, 3);
+  for (int lap = 0; lap < 4; lap++) {
+    testPoint = start;
+    lapTimerTestLoop(testPoint, 50, 5);
+    incrementTimerLoop(testPoint, 1, 80);
+  }
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 5) {
+    return false;
+  }
+
+  doves_time_t sectorsSum = lapTimer.getBestSectorTime(0) + lapTimer.getBestSectorTime(splitLines[0]) + lapTimer.getBestSectorTime(splitLines[1]);
+  if (lapTimer.getBestSectorTime(0) == 0 || lapTimer.getBestSectorTime(splitLines[1]) == 0 || lapTimer.getOptimalLapTime() != sectorsSum) {
+    return false;
+  }
+  return lapTimer.getOptimalLapTime() <= lapTimer.getBestLapTime() && lapTimer.getRollingBestLapTime() <= lapTimer.getBestLapTime();
+}
+
+#if DOVES_LAP_HISTORY_SIZE > 0
+bool testLapHistory() {
+  // lap 1 at 10 knots, lap 2 with a stretch at 20 knots
+  GpsCords start = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  GpsCords testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 40);
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  incrementTimerLoop(testPoint, 2, 10, 0, 20);
+  testPoint = start;
+  lapTimerTestLoop(testPoint, 50, 5);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (lapTimer.getLaps() != 2 || lapTimer.getLapHistoryCount() != 2) {
+    return false;
+  }
+
+  dovesLapRecord last, first;
+  if (!lapTimer.getLapRecord(0, last) || !lapTimer.getLapRecordByNumber(1, first) || lapTimer.getLapRecord(2, first) || lapTimer.getLapRecordByNumber(3, last)) {
+    return false;
+  }
+  if (last.lapNumber != 2 || last.lapTime != lapTimer.getLastLapTime() || fabs(last.distanceMeters - lapTimer.getLastLapDistance()) > 0.5) {
+    return false;
+  }
+  // the first crossing is rebuilt from the last one
+  if (first.lapNumber != 1 || first.crossingTime != last.crossingTime - last.lapTime) {
+    return false;
+  }
+  // 5 knots is 9.3km/h, 10 knots 18.5km/h and 20 knots 37km/h
+  if (first.topSpeedKmh != 19 || first.minSpeedKmh != 9 || last.topSpeedKmh != 37 || last.minSpeedKmh != 9) {
+    return false;
+  }
+  return true;
+}
+#endif
+
+bool testOdometerGate() {
+  lapTimer.setOdometerGate(3, 5, 0.1);
+  GpsCords testPoint = moveSouth(finishLineMidPoint, 100);
+  incrementTimerLoop(testPoint, 1, 5);
+  float parked = lapTimer.getTotalDistanceTraveled();
+
+  // parked, wandering a meter around
+  for (int i = 0; i < 50; i++) {
+    GpsCords wander = i % 2 == 0 ? moveEast(testPoint, 1) : moveWest(testPoint, 1);
+    lapTimerTestLoop(wander, 50 + i % 3, 0.5);
+  }
+  if (lapTimer.getTotalDistanceTraveled() != parked) {
+    return false;
+  }
+
+  // 10 meters, with a poor HDOP half way through
+  incrementTimerLoop(testPoint, 1, 5);
+  lapTimer.updateHdop(12);
+  incrementTimerLoop(testPoint, 1, 3);
+  lapTimer.updateHdop(1);
+  incrementTimerLoop(testPoint, 1, 2);
+  if (fabs(lapTimer.getTotalDistanceTraveled() - parked - 10) > 0.1) {
+    return false;
+  }
+
+  // creeping along at 0.2 meters a fix, under a half meter dead-band
+  lapTimer.setOdometerGate(3, 5, 0.5);
+  incrementTimerLoop(testPoint, 0.2, 10, 0, 3);
+  lapTimer.setOdometerGate(DOVES_ODOMETER_MIN_SPEED_KMH, DOVES_ODOMETER_MAX_HDOP, DOVES_ODOMETER_DEADBAND_METERS);
+  lapTimer.updateHdop(0);
+  if (fabs(lapTimer.getTotalDistanceTraveled() - parked - 12) > 0.3) {
+    return false;
+  }
+  return true;
+}
+
+#if DOVES_TRACE_RING_SIZE > 0
+bool testTraceRing() {
+  dovesTraceEvent event;
+  while (lapTimer.readTraceEvent(event)) {
+  }
+
+  // cross the start/finish line once
+  GpsCords testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  incrementTimerLoop(testPoint, 1, 20);
+  if (!lapTimer.getRaceStarted()) {
+    return false;
+  }
+
+  // entering the threshold, a few fixes buffered, then the pair and the crossing interpolated from it
+  int inserts = 0;
+  uint8_t lastType = 0;
+  while (lapTimer.readTraceEvent(event)) {
+    if (event.line != 0 || (lastType == 0 && event.type != DOVES_TRACE_THRESHOLD_ENTER)) {
+      return false;
+    }
+    if (event.type == DOVES_TRACE_BUFFER_INSERT) {
+      inserts++;
+    }
+    if (event.type == DOVES_TRACE_CROSSING && (lastType != DOVES_TRACE_PAIR_CHOSEN || event.time != (uint32_t)lapTimer.getLineCrossingTime(0))) {
+      return false;
+    }
+    lastType = event.type;
+  }
+  return inserts >= 10 && lastType == DOVES_TRACE_CROSSING && lapTimer.getTraceEventCount() == 0;
+}
+#endif
+
+#ifdef DOVES_PROFILE
+// every read of the clock is 5 ticks after the previous one
+unsigned long profileTicks = 0;
+unsigned long fakeProfileClock() {
+  profileTicks += 5;
+  return profileTicks;
+}
+
+bool testStageProfile() {
+  lapTimer.setProfileClock(fakeProfileClock);
+
+  // through the start/finish line
+  GpsCords testPoint = moveSouth(finishLineMidPoint, CROSSING_THRESHOLD_METERS + 1);
+  incrementTimerLoop(testPoint, 1, 20);
+
+  dovesStageProfile loop, distance, interpolate;
+  bool found = lapTimer.getStageProfile(DOVES_STAGE_LOOP, loop) && lapTimer.getStageProfile(DOVES_STAGE_LINE_DISTANCE, distance) &&
+      lapTimer.getStageProfile(DOVES_STAGE_INTERPOLATE, interpolate) && !lapTimer.getStageProfile(DOVES_STAGE_COUNT, loop);
+  lapTimer.setProfileClock(micros);
+  if (!found) {
+    return false;
+  }
+  uint32_t histogramCount = 0;
+  for (int i = 0; i < DOVES_PROFILE_BUCKETS; i++) {
+    histogramCount += loop.histogram[i];
+  }
+  if (loop.count != 20 || histogramCount != loop.count || loop.mean < loop.min || loop.mean > loop.max) {
+    return false;
+  }
+  // nothing timed runs inside pointLineSegmentDistance, 5 ticks every time, in the bucket of 4 to 7
+  if (distance.count == 0 || distance.min != 5 || distance.max != 5 || distance.histogram[3] != distance.count) {
+    return false;
+  }
+  // it runs inside the interpolation, which runs inside the loop
+  return interpolate.count == 1 && interpolate.min > distance.min && loop.max > interpolate.max;
+}
+#endif
+
 #ifdef DOVES_UNIT_TEST
 // Test case 1: t = 0
 bool testCatmullRom1() {
@@ -608,8 +1207,8 @@ void buildBuffer(crossingPointBufferEntry *testBuffer, const int bufferSize = 10
   float multiplier = 0.175;
 
   float currentSpeed = 20;
-  float currentOdometer = 1000;
-  unsigned long currentTime = 10000;
+  uint32_t currentOdometer = 1000000; // millimeters
+  doves_time_t currentTime = 10000;
 
   // define starting point for mock data
   GpsCords currentPoint = moveSouth(finishLineMidPoint, (bufferSize / metersToMove) + metersToMove + (bufferSize * multiplier));
@@ -621,7 +1220,7 @@ void buildBuffer(crossingPointBufferEntry *testBuffer, const int bufferSize = 10
 
     // update for next loop
     currentPoint = moveNorth(currentPoint, metersToMove);
-    currentOdometer += metersToMove;
+    currentOdometer += (uint32_t)(metersToMove * 1000);
     currentTime += 100;
     if (alterDistance) {
       metersToMove += metersToMove * multiplier; 
@@ -656,8 +1255,8 @@ bool testInterpolationOnCurve1() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -699,8 +1298,8 @@ bool testInterpolationOnCurve2() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -742,8 +1341,8 @@ bool testInterpolationOnCurve3() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -785,8 +1384,8 @@ bool testInterpolationOnCurve4() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -831,8 +1430,8 @@ bool testInterpolationLinear1() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -875,8 +1474,8 @@ bool testInterpolationLinear2() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -919,8 +1518,8 @@ bool testInterpolationLinear3() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -963,8 +1562,8 @@ bool testInterpolationLinear4() {
   // Variables to store the crossing point's latitude, longitude, time, and odometer
   double crossingLat;
   double crossingLng;
-  unsigned long crossingTime;
-  double crossingOdometer;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
 
   // Call the function
   lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng);
@@ -982,4 +1581,89 @@ bool testInterpolationLinear4() {
 
   return testsPassed;
 }
+
+// the same crossing, with the odometer wrapping its 32 bits (about 4295km) half way through the buffer
+bool testInterpolationOdometerWrap() {
+  const int bufferSize = 10;
+  crossingPointBufferEntry testBuffer[bufferSize];
+  buildBuffer(testBuffer, bufferSize, true, true);
+  uint32_t offset = 0xFFFFFFFFUL - testBuffer[bufferSize / 2].odometer;
+
+  for (int linear = 0; linear < 2; linear++) {
+    if (linear) {
+      lapTimer.forceLinearInterpolation();
+    }
+    uint32_t crossingOdometer[2];
+    for (int wrapped = 0; wrapped < 2; wrapped++) {
+      for (int i = 0; i < bufferSize; i++) {
+        lapTimer.crossingPointBuffer[i] = testBuffer[i];
+        lapTimer.crossingPointBuffer[i].odometer += wrapped ? offset : 0;
+      }
+      lapTimer.crossingPointBufferIndex = bufferSize;
+      lapTimer.crossingPointBufferFull = false;
+
+      double crossingLat;
+      double crossingLng;
+      doves_time_t crossingTime;
+      if (!lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer[wrapped], crossingPointALat, crossingPointALng, crossingPointBLat, crossingPointBLng)) {
+        return false;
+      }
+    }
+    if (crossingOdometer[1] - offset != crossingOdometer[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool testLapStatistics() {
+  lapTimer.setLapStatsExclusions(DOVES_LAP_IN_LAP | DOVES_LAP_OUT_LAP, 1.5);
+
+  // 20 laps from 60.0s to 61.9s in a scrambled order, plus an out lap and a lap under yellow
+  lapTimer.addLapStatistics(75000, DOVES_LAP_OUT_LAP);
+  for (int i = 0; i < 20; i++) {
+    lapTimer.addLapStatistics(60000 + (i * 7 % 20) * 100, 0);
+    if (i == 10) {
+      lapTimer.addLapStatistics(120000, 0);
+    }
+  }
+  lapTimer.setLapStatsExclusions(DOVES_LAP_IN_LAP | DOVES_LAP_OUT_LAP, 0);
+
+  if (lapTimer.getStatsLapCount() != 20 || fabs(lapTimer.getMeanLapTime() - 60950) > 0.01) {
+    return false;
+  }
+  // sample standard deviation of 0..19 * 100
+  if (fabs(lapTimer.getLapTimeStdDev() - 591.6080) > 0.01 || fabs(lapTimer.getLapConsistency() - (100 - 59160.80 / 60950)) > 0.01) {
+    return false;
+  }
+  // estimates only, within 2 lap steps of the exact 60950 and 61810 this early on
+  long median = (long)lapTimer.getMedianLapTime();
+  long p90 = (long)lapTimer.getP90LapTime();
+  if (abs(median - 60950) > 200 || abs(p90 - 61810) > 200) {
+    return false;
+  }
+  return true;
+}
+
+#if DOVES_LAP_HISTORY_SIZE > 0
+// point-to-point stages far apart, longer than an hour and 40km, come back out of the history as they went in
+bool testLapHistoryLongStages() {
+  const doves_time_t hour = (doves_time_t)3600 * DOVES_TIME_UNITS_PER_SECOND;
+  doves_time_t firstStart = hour;
+  doves_time_t firstEnd = firstStart + 2 * hour;
+  doves_time_t secondStart = firstEnd + 3 * hour;
+  doves_time_t secondEnd = secondStart + hour / 2;
+  lapTimer.addLapRecord(firstEnd - firstStart, 41234.5, firstEnd, 0);
+  lapTimer.addLapRecord(secondEnd - secondStart, 12000, secondEnd, 0);
+
+  dovesLapRecord first, second;
+  if (!lapTimer.getLapRecord(1, first) || !lapTimer.getLapRecord(0, second)) {
+    return false;
+  }
+  if (first.lapTime != 2 * hour || first.crossingTime != firstEnd || fabs(first.distanceMeters - 41234.5) > 0.1) {
+    return false;
+  }
+  return second.lapTime == hour / 2 && second.crossingTime == secondEnd;
+}
+#endif
 #endif
\ No newline at end of file
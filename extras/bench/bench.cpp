@@ -0,0 +1,204 @@
+/**
+ * Microbenchmarks of the geometry and interpolation kernels, fed with fixes from the bundled track datasets.
+ *
+ * Usage: doves_bench [--min-time seconds] [--filter name]
+ *
+ * Prints one JSON object per line: first the build context, then a result per benchmark and case,
+ * with the best and median time per call over 5 repetitions. Keep the output of a baseline around and diff against it.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "../replay/nmea.h"
+
+#define BENCH_REPETITIONS 5
+
+// every result is folded into this, so the calls can't be optimized away
+static volatile double sink;
+
+static double minTime = 0.1;
+static std::string filter;
+
+/**
+ * @brief Times body, which makes calls calls per run, and prints the result as a line of JSON.
+ */
+template<typename Body>
+static void bench(const char *name, const std::string &inputCase, size_t calls, Body body) {
+  if (!filter.empty() && std::string(name).find(filter) == std::string::npos) {
+    return;
+  }
+
+  // double the runs per repetition until one repetition takes long enough to time
+  size_t runs = 1;
+  double seconds = 0;
+  while (true) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; i++) {
+      body();
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds >= minTime / BENCH_REPETITIONS) {
+      break;
+    }
+    runs *= 2;
+  }
+
+  std::vector<double> nsPerCall;
+  for (int repetition = 0; repetition < BENCH_REPETITIONS; repetition++) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; i++) {
+      body();
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    nsPerCall.push_back(seconds * 1e9 / (runs * calls));
+  }
+  std::sort(nsPerCall.begin(), nsPerCall.end());
+  printf("{\"benchmark\":\"%s\",\"case\":\"%s\",\"calls\":%zu,\"best_ns\":%.2f,\"median_ns\":%.2f}\n",
+         name, inputCase.c_str(), runs * calls, nsPerCall[0], nsPerCall[BENCH_REPETITIONS / 2]);
+  fflush(stdout);
+}
+
+/**
+ * @brief Fills the crossing buffer of the lap timer with size consecutive fixes around a crossing of the line.
+ */
+static bool fillCrossingBuffer(DovesLapTimer &lapTimer, const std::vector<fix> &fixes, size_t crossing, size_t size) {
+  if (size > (size_t)DovesLapTimer::crossingPointBufferSize || size > fixes.size()) {
+    return false;
+  }
+  size_t first = std::min(crossing - std::min(crossing, size / 2), fixes.size() - size);
+  uint32_t odometer = 0;
+  for (size_t i = 0; i < size; i++) {
+    const fix &f = fixes[first + i];
+    if (i > 0) {
+      odometer += (uint32_t)(lapTimer.haversine(fixes[first + i - 1].lat, fixes[first + i - 1].lng, f.lat, f.lng) * 1000);
+    }
+    lapTimer.crossingPointBuffer[i] = {f.lat, f.lng, f.time, odometer, f.speedKnots * 1.852f};
+  }
+  lapTimer.crossingPointBufferIndex = size % DovesLapTimer::crossingPointBufferSize;
+  lapTimer.crossingPointBufferFull = size == (size_t)DovesLapTimer::crossingPointBufferSize;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--min-time" && i + 1 < argc) {
+      minTime = atof(argv[++i]);
+    } else if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--min-time seconds] [--filter name]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  DovesLapTimer lapTimer;
+  const double *line = defaultLine;
+  std::vector<fix> fixes = parseFixes(bundledSentences(twoLapsData::gps_logs, sizeof(twoLapsData::gps_logs) / sizeof(char *)));
+
+  // near the line is inside the crossing threshold or about to be, far is the rest of the lap
+  std::vector<fix> nearLine, farFromLine;
+  size_t crossing = 0;
+  for (size_t i = 0; i < fixes.size(); i++) {
+    double distance = lapTimer.pointLineSegmentDistance(fixes[i].lat, fixes[i].lng, line[0], line[1], line[2], line[3]);
+    if (distance < 15) {
+      nearLine.push_back(fixes[i]);
+    } else if (distance > 100) {
+      farFromLine.push_back(fixes[i]);
+    }
+    // the crossing closest to the middle of the log, so the biggest buffers still fit around it
+    if (i > 0 && distance < 15 &&
+        lapTimer.pointOnSideOfLine(fixes[i - 1].lat, fixes[i - 1].lng, line[0], line[1], line[2], line[3]) != lapTimer.pointOnSideOfLine(fixes[i].lat, fixes[i].lng, line[0], line[1], line[2], line[3]) &&
+        (crossing == 0 || labs((long)i - (long)fixes.size() / 2) < labs((long)crossing - (long)fixes.size() / 2))) {
+      crossing = i;
+    }
+  }
+
+  printf("{\"context\":{\"fixes\":%zu,\"near_line\":%zu,\"far_from_line\":%zu,\"time_units_per_second\":%lu,\"crossing_buffer_size\":%d,\"compiler\":\"%s\"}}\n",
+         fixes.size(), nearLine.size(), farFromLine.size(), (unsigned long)DOVES_TIME_UNITS_PER_SECOND, DovesLapTimer::crossingPointBufferSize, __VERSION__);
+
+  std::pair<const char *, const std::vector<fix> *> cases[] = {{"near_line", &nearLine}, {"far_from_line", &farFromLine}};
+  for (const auto &inputCase : cases) {
+    const std::vector<fix> &input = *inputCase.second;
+    size_t count = input.size();
+
+    // between consecutive fixes, like the odometer
+    bench("haversine", inputCase.first, count - 1, [&]() {
+      double sum = 0;
+      for (size_t i = 1; i < count; i++) {
+        sum += lapTimer.haversine(input[i - 1].lat, input[i - 1].lng, input[i].lat, input[i].lng);
+      }
+      sink = sum;
+    });
+    bench("haversine3D", inputCase.first, count - 1, [&]() {
+      double sum = 0;
+      for (size_t i = 1; i < count; i++) {
+        sum += lapTimer.haversine3D(input[i - 1].lat, input[i - 1].lng, input[i - 1].altitude, input[i].lat, input[i].lng, input[i].altitude);
+      }
+      sink = sum;
+    });
+    // against the start/finish line, like the crossing checks
+    bench("pointLineSegmentDistance", inputCase.first, count, [&]() {
+      double sum = 0;
+      for (size_t i = 0; i < count; i++) {
+        sum += lapTimer.pointLineSegmentDistance(input[i].lat, input[i].lng, line[0], line[1], line[2], line[3]);
+      }
+      sink = sum;
+    });
+    bench("insideLineThreshold", inputCase.first, count, [&]() {
+      int inside = 0;
+      for (size_t i = 0; i < count; i++) {
+        inside += lapTimer.insideLineThreshold(input[i].lat, input[i].lng, line[0], line[1], line[2], line[3]);
+      }
+      sink = inside;
+    });
+    bench("isObtuseTriangle", inputCase.first, count, [&]() {
+      int obtuse = 0;
+      for (size_t i = 0; i < count; i++) {
+        obtuse += lapTimer.isObtuseTriangle(input[i].lat, input[i].lng, line[0], line[1], line[2], line[3]);
+      }
+      sink = obtuse;
+    });
+    // the latitudes of 4 consecutive fixes, as interpolateCrossingPoint() uses them
+    bench("catmullRom", inputCase.first, count - 3, [&]() {
+      double sum = 0;
+      for (size_t i = 3; i < count; i++) {
+        sum += lapTimer.catmullRom(input[i - 3].lat, input[i - 2].lat, input[i - 1].lat, input[i].lat, (i % 10) / 10.0);
+      }
+      sink = sum;
+    });
+  }
+
+  int bufferSizes[] = {50, 200, 500};
+  for (int size : bufferSizes) {
+    if (!fillCrossingBuffer(lapTimer, fixes, crossing, size)) {
+      continue;
+    }
+    std::string inputCase = "buffer_" + std::to_string(size);
+    for (int linear = 0; linear < 2; linear++) {
+      if (linear) {
+        lapTimer.forceLinearInterpolation();
+      } else {
+        lapTimer.forceCatmullRomInterpolation();
+      }
+      double crossingLat, crossingLng;
+      doves_time_t crossingTime;
+      uint32_t crossingOdometer;
+      if (!lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, line[0], line[1], line[2], line[3])) {
+        fprintf(stderr, "no crossing found in %s\n", inputCase.c_str());
+        return 1;
+      }
+      bench(linear ? "interpolateCrossingPoint_linear" : "interpolateCrossingPoint_catmullRom", inputCase, 1, [&]() {
+        double crossingLat, crossingLng;
+        doves_time_t crossingTime = 0;
+        uint32_t crossingOdometer = 0;
+        lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, line[0], line[1], line[2], line[3]);
+        sink = (double)crossingTime;
+      });
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include "Arduino.h"
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+Stream Serial;
+
+static std::chrono::steady_clock::time_point bootTime() {
+  static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+  return boot;
+}
+
+// wraps like the 32 bit counters of most boards, even where unsigned long is 64 bits
+unsigned long micros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime()).count();
+}
+unsigned long millis() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime()).count();
+}
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+size_t Stream::print(const char *text) {
+  return fputs(text, stdout) < 0 ? 0 : strlen(text);
+}
+size_t Stream::print(char c) {
+  return putchar(c) == EOF ? 0 : 1;
+}
+size_t Stream::print(int value, int base) {
+  return print((long long)value, base);
+}
+size_t Stream::print(unsigned int value, int base) {
+  return print((unsigned long long)value, base);
+}
+size_t Stream::print(long value, int base) {
+  return print((long long)value, base);
+}
+size_t Stream::print(unsigned long value, int base) {
+  return print((unsigned long long)value, base);
+}
+size_t Stream::print(long long value, int base) {
+  // like the Arduino core, only decimal numbers get a sign
+  if (value < 0 && base == DEC) {
+    return print('-') + print((unsigned long long)-value, base);
+  }
+  return print((unsigned long long)value, base);
+}
+size_t Stream::print(unsigned long long value, int base) {
+  return printf(base == HEX ? "%llX" : "%llu", value);
+}
+size_t Stream::print(double value, int digits) {
+  return printf("%.*f", digits, value);
+}
+// a plain newline, the terminal or log file on the other end isn't a serial monitor
+size_t Stream::println() {
+  return print('\n');
+}
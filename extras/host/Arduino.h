@@ -0,0 +1,64 @@
+/**
+ * Just enough of the Arduino core to build the lap timer on a desktop, for replaying logs, benchmarks and tests.
+ * Only what the library itself uses is here, sketches needing more belong on a board.
+ *
+ * Time comes from the monotonic host clock, counted from the first call like on a freshly booted board.
+ * Serial writes to stdout.
+ */
+
+#ifndef _DOVES_HOST_ARDUINO_H
+#define _DOVES_HOST_ARDUINO_H
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __cplusplus
+#include <cmath>
+// the core's abs() is a macro working on any type, not just int
+using std::abs;
+#endif
+
+#define PI 3.1415926535897932384626433832795
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define DEC 10
+#define HEX 16
+
+#define radians(deg) ((deg) * DEG_TO_RAD)
+#define degrees(rad) ((rad) * RAD_TO_DEG)
+#define sq(x) ((x) * (x))
+#define F(string) (string)
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+
+class Stream {
+public:
+  void begin(unsigned long) {}
+  operator bool() const { return true; }
+
+  size_t print(const char *text);
+  size_t print(char c);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(long long value, int base = DEC);
+  size_t print(unsigned long long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+
+  // println() is print() plus a line break, for every overload above
+  size_t println();
+  template<typename... Args>
+  size_t println(Args... args) {
+    size_t written = print(args...);
+    return written + println();
+  }
+};
+
+extern Stream Serial;
+
+#endif
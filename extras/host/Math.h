@@ -0,0 +1,8 @@
+/**
+ * Some sketches include <Math.h>, which only resolves to <math.h> on case-insensitive file systems.
+ */
+
+#ifndef _DOVES_HOST_MATH_H
+#define _DOVES_HOST_MATH_H
+#include <math.h>
+#endif
@@ -0,0 +1,8 @@
+/**
+ * Empty stand-in for the I2C library, so sketches that include it but never talk to a device build on a desktop.
+ */
+
+#ifndef _DOVES_HOST_WIRE_H
+#define _DOVES_HOST_WIRE_H
+#include "Arduino.h"
+#endif
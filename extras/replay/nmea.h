@@ -0,0 +1,106 @@
+/**
+ * NMEA parsing and the bundled track datasets, shared by the host tools.
+ */
+
+#ifndef _DOVES_NMEA_H
+#define _DOVES_NMEA_H
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "DovesLapTimer.h"
+
+namespace lapData {
+#include "../../examples/real_track_data_debug/gps_race_data_lap.h"
+}
+namespace twoLapsData {
+#include "../../examples/real_track_data_debug/gps_race_data_2laps.h"
+}
+namespace longLapData {
+#include "../../examples/real_track_data_debug/gps_race_data_long_lap.h"
+}
+
+// the shorter white line at Orlando Kart Center, the one the bundled datasets are timed against
+static const double defaultLine[4] = {28.41272398509636, -81.37961173507423, 28.412712209918887, -81.37971443944673};
+
+struct fix {
+  double lat;
+  double lng;
+  float altitude;
+  float speedKnots;
+  float hdop;
+  doves_time_t time;
+};
+
+// NMEA checksum, the XOR of everything between $ and *
+inline bool validChecksum(const std::string &sentence) {
+  size_t star = sentence.find('*');
+  if (sentence.empty() || sentence[0] != '$' || star == std::string::npos || star + 3 > sentence.size()) {
+    return false;
+  }
+  unsigned char sum = 0;
+  for (size_t i = 1; i < star; i++) {
+    sum ^= (unsigned char)sentence[i];
+  }
+  return sum == (unsigned char)strtoul(sentence.substr(star + 1, 2).c_str(), nullptr, 16);
+}
+
+inline std::vector<std::string> splitFields(const std::string &sentence) {
+  std::vector<std::string> fields;
+  std::string field;
+  for (size_t i = 0; i < sentence.size() && sentence[i] != '*'; i++) {
+    if (sentence[i] == ',') {
+      fields.push_back(field);
+      field.clear();
+    } else {
+      field += sentence[i];
+    }
+  }
+  fields.push_back(field);
+  return fields;
+}
+
+// ddmm.mmmm plus hemisphere to decimal degrees
+inline double nmeaDegrees(const std::string &value, const std::string &hemisphere) {
+  double raw = atof(value.c_str());
+  int degrees = (int)(raw / 100);
+  double result = degrees + (raw - degrees * 100) / 60;
+  return hemisphere == "S" || hemisphere == "W" ? -result : result;
+}
+
+// hhmmss.sss to time since midnight in time units
+inline doves_time_t nmeaTime(const std::string &value) {
+  if (value.size() < 6) {
+    return 0;
+  }
+  unsigned long ms = atoi(value.substr(0, 2).c_str()) * 3600000UL + atoi(value.substr(2, 2).c_str()) * 60000UL + (unsigned long)(atof(value.substr(4).c_str()) * 1000 + 0.5);
+  return (doves_time_t)ms * (DOVES_TIME_UNITS_PER_SECOND / 1000);
+}
+
+/**
+ * @brief Turns the sentences of a log into fixes, so the timed replay only runs the lap timer.
+ */
+inline std::vector<fix> parseFixes(const std::vector<std::string> &sentences) {
+  std::vector<fix> fixes;
+  float altitude = 0;
+  float hdop = 0;
+  for (const std::string &sentence : sentences) {
+    if (!validChecksum(sentence)) {
+      continue;
+    }
+    std::vector<std::string> fields = splitFields(sentence);
+    std::string type = fields[0].size() >= 6 ? fields[0].substr(3) : "";
+    if (type == "GGA" && fields.size() > 9) {
+      hdop = atof(fields[8].c_str());
+      altitude = atof(fields[9].c_str());
+    } else if (type == "RMC" && fields.size() > 7 && fields[2] == "A") {
+      fixes.push_back({nmeaDegrees(fields[3], fields[4]), nmeaDegrees(fields[5], fields[6]), altitude, (float)atof(fields[7].c_str()), hdop, nmeaTime(fields[1])});
+    }
+  }
+  return fixes;
+}
+
+inline std::vector<std::string> bundledSentences(const char **logs, size_t count) {
+  return std::vector<std::string>(logs, logs + count);
+}
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * Replays NMEA logs through the lap timer on a desktop, printing every lap next to the reference timing
+ * and how many fixes a second the timer got through.
+ *
+ * Usage: doves_replay [--linear] [--repeat N] [--line aLat,aLng,bLat,bLng] [log.nmea ...]
+ *
+ * Without log files the datasets bundled with the real track data example are replayed,
+ * log files are timed against the same start/finish line unless --line is given.
+ * Only RMC (position, speed, time) and GGA (altitude, HDOP) sentences are used, lines with a bad checksum are skipped.
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include "nmea.h"
+
+struct dataset {
+  std::string name;
+  std::vector<std::string> sentences;
+  // reference timing of each lap in milliseconds, in the order the laps are completed, 0 if there is none
+  std::vector<unsigned long> myLaps; // magnetic loop, official
+  std::vector<unsigned long> raceChrono; // GPS phone app
+};
+
+static bool readLog(const char *path, dataset &log) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+  log.name = path;
+  char line[256];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    std::string sentence(line);
+    sentence.erase(sentence.find_last_not_of("\r\n") + 1);
+    log.sentences.push_back(sentence);
+  }
+  fclose(file);
+  return true;
+}
+
+static std::string formatTime(double seconds) {
+  char text[32];
+  const char *sign = seconds < 0 ? "-" : "";
+  seconds = fabs(seconds);
+  snprintf(text, sizeof(text), "%s%d:%06.3f", sign, (int)(seconds / 60), fmod(seconds, 60));
+  return text;
+}
+
+static void printReference(const char *name, const std::vector<unsigned long> &reference, int lapNumber, double lapSeconds) {
+  if (lapNumber > (int)reference.size() || reference[lapNumber - 1] == 0) {
+    return;
+  }
+  double referenceSeconds = reference[lapNumber - 1] / 1000.0;
+  printf("  %s %s (%+.3fs)", name, formatTime(referenceSeconds).c_str(), lapSeconds - referenceSeconds);
+}
+
+/**
+ * @brief Replays a log, prints its laps against the reference and returns the fixes a second the timer processed.
+ */
+static double replay(const dataset &log, const double line[4], bool linear, int repeat) {
+  std::vector<fix> fixes = parseFixes(log.sentences);
+
+  DovesLapTimer lapTimer;
+  double seconds = 0;
+  for (int run = 0; run < repeat; run++) {
+    lapTimer.clearTimingLines();
+    lapTimer.setStartFinishLine(line[0], line[1], line[2], line[3]);
+    if (linear) {
+      lapTimer.forceLinearInterpolation();
+    } else {
+      lapTimer.forceCatmullRomInterpolation();
+    }
+    lapTimer.reset();
+
+    auto start = std::chrono::steady_clock::now();
+    for (const fix &f : fixes) {
+      lapTimer.updateHdop(f.hdop);
+      lapTimer.loop(f.lat, f.lng, f.altitude, f.speedKnots, f.time);
+    }
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  printf("%s: %zu fixes, %d laps (%s)\n", log.name.c_str(), fixes.size(), lapTimer.getLaps(), linear ? "linear" : "catmull-rom");
+  for (int age = lapTimer.getLapHistoryCount() - 1; age >= 0; age--) {
+    dovesLapRecord lap;
+    lapTimer.getLapRecord(age, lap);
+    double lapSeconds = (double)lap.lapTime / DOVES_TIME_UNITS_PER_SECOND;
+    printf("  lap %2d  %s  %7.1fm", lap.lapNumber, formatTime(lapSeconds).c_str(), lap.distanceMeters);
+    printReference("MyLaps", log.myLaps, lap.lapNumber, lapSeconds);
+    printReference("RaceChrono", log.raceChrono, lap.lapNumber, lapSeconds);
+    printf("\n");
+  }
+
+  double fixesPerSecond = seconds > 0 ? fixes.size() * (double)repeat / seconds : 0;
+  printf("  %.0f fixes/s (%d runs, %.3f ms per run)\n\n", fixesPerSecond, repeat, seconds * 1000 / repeat);
+  return fixesPerSecond;
+}
+
+int main(int argc, char **argv) {
+  bool linear = false;
+  int repeat = 100;
+  double line[4] = {defaultLine[0], defaultLine[1], defaultLine[2], defaultLine[3]};
+  std::vector<dataset> logs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--linear") {
+      linear = true;
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--line" && i + 1 < argc) {
+      if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &line[0], &line[1], &line[2], &line[3]) != 4) {
+        fprintf(stderr, "--line takes aLat,aLng,bLat,bLng\n");
+        return 2;
+      }
+    } else if (arg[0] == '-') {
+      fprintf(stderr, "usage: %s [--linear] [--repeat N] [--line aLat,aLng,bLat,bLng] [log.nmea ...]\n", argv[0]);
+      return 2;
+    } else {
+      dataset log;
+      if (!readLog(argv[i], log)) {
+        fprintf(stderr, "can't read %s\n", argv[i]);
+        return 1;
+      }
+      logs.push_back(log);
+    }
+  }
+
+  if (logs.empty()) {
+    // reference times from the dataset headers
+    logs.push_back({"gps_race_data_lap", bundledSentences(lapData::gps_logs, sizeof(lapData::gps_logs) / sizeof(char *)), {68807}, {68630}});
+    logs.push_back({"gps_race_data_2laps", bundledSentences(twoLapsData::gps_logs, sizeof(twoLapsData::gps_logs) / sizeof(char *)), {0, 68807}, {70080, 68630}});
+    logs.push_back({"gps_race_data_long_lap", bundledSentences(longLapData::gps_logs, sizeof(longLapData::gps_logs) / sizeof(char *)), {}, {58640}});
+  }
+
+  double total = 0;
+  for (const dataset &log : logs) {
+    total += replay(log, line, linear, repeat);
+  }
+  printf("mean %.0f fixes/s\n", total / logs.size());
+  return 0;
+}
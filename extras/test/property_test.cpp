@@ -0,0 +1,246 @@
+/**
+ * Randomized property tests of the geometry and interpolation kernels, so a faster implementation can be
+ * checked against the behaviour of the reference one on thousands of cases in a few seconds.
+ *
+ * Usage: doves_property_test [--seed N] [--iterations N]
+ *
+ * Every property is checked on positions between 60 degrees south and north, at the scale of a track.
+ * Failures print the seed and the case, rerun with the same seed to reproduce them.
+ * Exits with 0 if every property holds.
+ */
+
+#include <random>
+#include <string>
+#include <stdio.h>
+#include "DovesLapTimer.h"
+
+static const double EARTH_RADIUS_METERS = 6371000;
+
+struct point {
+  double lat;
+  double lng;
+};
+
+static std::mt19937_64 rng;
+static unsigned long seed = 1;
+static int failures = 0;
+
+static double uniform(double low, double high) {
+  return std::uniform_real_distribution<double>(low, high)(rng);
+}
+
+/**
+ * @brief Moves a point by a number of meters east and north, in the flat earth approximation that holds at track scale.
+ */
+static point offset(point p, double eastMeters, double northMeters) {
+  point moved;
+  moved.lat = p.lat + degrees(northMeters / EARTH_RADIUS_METERS);
+  moved.lng = p.lng + degrees(eastMeters / (EARTH_RADIUS_METERS * cos(radians(p.lat))));
+  return moved;
+}
+
+static point randomPoint() {
+  return {uniform(-60, 60), uniform(-180, 180)};
+}
+
+/**
+ * @brief Textbook haversine, written independently of the library so an optimized kernel can be compared against it.
+ */
+static double referenceHaversine(point a, point b) {
+  double deltaLat = radians(b.lat - a.lat);
+  double deltaLng = radians(b.lng - a.lng);
+  double h = sin(deltaLat / 2) * sin(deltaLat / 2) + cos(radians(a.lat)) * cos(radians(b.lat)) * sin(deltaLng / 2) * sin(deltaLng / 2);
+  return 2 * EARTH_RADIUS_METERS * asin(std::min(1.0, sqrt(h)));
+}
+
+static bool nearlyEqual(double a, double b, double absolute, double relative = 1e-9) {
+  return fabs(a - b) <= absolute + relative * std::max(fabs(a), fabs(b));
+}
+
+static bool check(bool condition, const char *property, int iteration, const std::string &details) {
+  if (!condition) {
+    if (failures < 20) {
+      printf("FAILED %s (seed %lu, iteration %d): %s\n", property, seed, iteration, details.c_str());
+    }
+    failures++;
+  }
+  return condition;
+}
+
+static std::string describe(const char *format, double a, double b = 0, double c = 0, double d = 0) {
+  char text[256];
+  snprintf(text, sizeof(text), format, a, b, c, d);
+  return text;
+}
+
+static void haversineProperties(DovesLapTimer &lapTimer, int iteration) {
+  point a = randomPoint();
+  point b = offset(a, uniform(-5000, 5000), uniform(-5000, 5000));
+
+  double ab = lapTimer.haversine(a.lat, a.lng, b.lat, b.lng);
+  double ba = lapTimer.haversine(b.lat, b.lng, a.lat, a.lng);
+  check(nearlyEqual(ab, ba, 1e-6), "haversine symmetry", iteration, describe("%.9f != %.9f", ab, ba));
+  check(lapTimer.haversine(a.lat, a.lng, a.lat, a.lng) == 0, "haversine of a point to itself", iteration, describe("%.9f, %.9f", a.lat, a.lng));
+
+  double reference = referenceHaversine(a, b);
+  check(nearlyEqual(ab, reference, 1e-6), "haversine matches the reference", iteration, describe("%.9f != %.9f", ab, reference));
+
+  point c = offset(a, uniform(-5000, 5000), uniform(-5000, 5000));
+  double ac = lapTimer.haversine(a.lat, a.lng, c.lat, c.lng);
+  double bc = lapTimer.haversine(b.lat, b.lng, c.lat, c.lng);
+  check(ac <= ab + bc + 1e-6, "haversine triangle inequality", iteration, describe("%.9f > %.9f + %.9f", ac, ab, bc));
+
+  double altitudeA = uniform(-100, 3000);
+  double altitudeB = altitudeA + uniform(-50, 50);
+  double ab3D = lapTimer.haversine3D(a.lat, a.lng, altitudeA, b.lat, b.lng, altitudeB);
+  double ba3D = lapTimer.haversine3D(b.lat, b.lng, altitudeB, a.lat, a.lng, altitudeA);
+  check(nearlyEqual(ab3D, ba3D, 1e-6), "haversine3D symmetry", iteration, describe("%.9f != %.9f", ab3D, ba3D));
+  check(ab3D >= ab - 1e-6 && ab3D <= ab + fabs(altitudeB - altitudeA) + 1e-6, "haversine3D between flat and flat plus climb", iteration, describe("%.9f, flat %.9f", ab3D, ab));
+}
+
+static void lineProperties(DovesLapTimer &lapTimer, int iteration) {
+  point a = randomPoint();
+  double heading = uniform(0, 2 * PI);
+  double length = uniform(3, 30);
+  point b = offset(a, length * sin(heading), length * cos(heading));
+
+  // a point on either side of the line, clear of it so rounding can't put it on the line
+  double along = uniform(-0.5, 1.5) * length;
+  double across = uniform(0.05, 50);
+  point base = offset(a, along * sin(heading), along * cos(heading));
+  point left = offset(base, -across * cos(heading), across * sin(heading));
+  point right = offset(base, across * cos(heading), -across * sin(heading));
+
+  int sideLeft = lapTimer.pointOnSideOfLine(left.lat, left.lng, a.lat, a.lng, b.lat, b.lng);
+  int sideRight = lapTimer.pointOnSideOfLine(right.lat, right.lng, a.lat, a.lng, b.lat, b.lng);
+  check(sideLeft != 0 && sideLeft == -sideRight, "points across the line are on opposite sides", iteration, describe("sides %.0f and %.0f, %.3fm off the line", sideLeft, sideRight, across));
+  int swapped = lapTimer.pointOnSideOfLine(left.lat, left.lng, b.lat, b.lng, a.lat, a.lng);
+  check(swapped == -sideLeft, "swapping the line ends swaps the sides", iteration, describe("side %.0f, swapped %.0f", sideLeft, swapped));
+
+  double distance = lapTimer.pointLineSegmentDistance(left.lat, left.lng, a.lat, a.lng, b.lat, b.lng);
+  double distanceSwapped = lapTimer.pointLineSegmentDistance(left.lat, left.lng, b.lat, b.lng, a.lat, a.lng);
+  check(nearlyEqual(distance, distanceSwapped, 1e-6, 1e-6), "segment distance symmetry", iteration, describe("%.9f != %.9f", distance, distanceSwapped));
+
+  double toA = lapTimer.haversine(left.lat, left.lng, a.lat, a.lng);
+  double toB = lapTimer.haversine(left.lat, left.lng, b.lat, b.lng);
+  check(distance >= 0 && distance <= std::max(toA, toB) + 1e-6, "segment distance no further than the ends", iteration, describe("%.9f, ends %.9f and %.9f", distance, toA, toB));
+  if (along >= 0 && along <= length) {
+    // the projection is made in degrees, so away from the equator it lands near the true foot of the perpendicular, never closer
+    check(distance >= across - 1e-3, "segment distance of a point beside the segment", iteration, describe("%.9f, %.9f off the line", distance, across));
+  }
+
+  point middle = {(a.lat + b.lat) / 2, (a.lng + b.lng) / 2};
+  double onLine = lapTimer.pointLineSegmentDistance(middle.lat, middle.lng, a.lat, a.lng, b.lat, b.lng);
+  check(onLine < 1e-3, "segment distance of a point on the segment", iteration, describe("%.9f", onLine));
+}
+
+/**
+ * @brief Fills the crossing buffer with a pass over a line, on a gentle curve at a varying speed and fix rate,
+ * then checks the interpolated crossing lies between the two fixes on either side of the line, and on the line.
+ */
+static void interpolationProperties(DovesLapTimer &lapTimer, int iteration, bool linear) {
+  point a = randomPoint();
+  double lineHeading = uniform(0, 2 * PI);
+  double lineLength = uniform(5, 20);
+  point b = offset(a, lineLength * sin(lineHeading), lineLength * cos(lineHeading));
+
+  // approach the line at an angle, crossing somewhere in its middle
+  double crossAlong = uniform(0.2, 0.8) * lineLength;
+  point crossing = offset(a, crossAlong * sin(lineHeading), crossAlong * cos(lineHeading));
+  double heading = lineHeading + PI / 2 + uniform(-PI / 4, PI / 4);
+  if (uniform(0, 1) < 0.5) {
+    heading += PI;
+  }
+  double turnRate = uniform(-0.005, 0.005); // radians per meter
+  double speedKmh = uniform(20, 150);
+  double fixSeconds = 1.0 / (int)uniform(5, 26);
+  int count = (int)uniform(6, 60);
+  int crossingFix = (int)uniform(1, count - 2); // the last fix before the line
+
+  // the distance from the crossing of every fix, along the path, never closer to the line than a centimeter
+  double metersPerFix = speedKmh / 3.6 * fixSeconds;
+  double crossingOffset = uniform(0.05, 0.95);
+  if (metersPerFix * std::min(crossingOffset, 1 - crossingOffset) < 0.01) {
+    crossingOffset = 0.5;
+  }
+
+  crossingPointBufferEntry *buffer = lapTimer.crossingPointBuffer;
+  doves_time_t time = (doves_time_t)uniform(0, 1e9);
+  uint32_t odometer = (uint32_t)uniform(0, 4e9); // wraps on long enough runs
+  for (int i = 0; i < count; i++) {
+    double pathMeters = (i - crossingFix - crossingOffset) * metersPerFix;
+    // a circle arc through the crossing point
+    double pathHeading = heading + turnRate * pathMeters;
+    double east, north;
+    if (fabs(turnRate) < 1e-9) {
+      east = pathMeters * sin(heading);
+      north = pathMeters * cos(heading);
+    } else {
+      east = (cos(heading) - cos(pathHeading)) / turnRate;
+      north = (sin(pathHeading) - sin(heading)) / turnRate;
+    }
+    point fix = offset(crossing, east, north);
+    float fixSpeed = speedKmh * uniform(0.9, 1.1);
+    buffer[i] = {fix.lat, fix.lng, time, odometer, fixSpeed};
+    time += (doves_time_t)(fixSeconds * DOVES_TIME_UNITS_PER_SECOND);
+    odometer += (uint32_t)(metersPerFix * 1000);
+  }
+  lapTimer.crossingPointBufferIndex = count;
+  lapTimer.crossingPointBufferFull = false;
+  if (linear) {
+    lapTimer.forceLinearInterpolation();
+  } else {
+    lapTimer.forceCatmullRomInterpolation();
+  }
+
+  const char *property = linear ? "linear crossing between its fixes" : "Catmull-Rom crossing between its fixes";
+  double crossingLat, crossingLng;
+  doves_time_t crossingTime;
+  uint32_t crossingOdometer;
+  if (!check(lapTimer.interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, a.lat, a.lng, b.lat, b.lng), property, iteration, "no crossing found")) {
+    return;
+  }
+
+  const crossingPointBufferEntry &before = buffer[crossingFix];
+  const crossingPointBufferEntry &after = buffer[crossingFix + 1];
+  check(crossingTime >= before.time && crossingTime <= after.time, property, iteration,
+    describe("time %.0f outside %.0f..%.0f", (double)crossingTime, (double)before.time, (double)after.time));
+  check(crossingOdometer - before.odometer <= after.odometer - before.odometer, property, iteration,
+    describe("odometer %.0f outside %.0f..%.0f", crossingOdometer, before.odometer, after.odometer));
+
+  // the spline may bulge out a little on a curve, never by more than a fraction of the gap between the fixes
+  double gap = lapTimer.haversine(before.lat, before.lng, after.lat, after.lng);
+  double offPath = lapTimer.pointLineSegmentDistance(crossingLat, crossingLng, before.lat, before.lng, after.lat, after.lng);
+  check(offPath <= (linear ? 1e-3 : 0.1 * gap + 1e-3), property, iteration, describe("%.6fm off a %.6fm gap", offPath, gap));
+
+  // and it lands on the line, give or take the speed changing by up to 10% between the fixes
+  double offLine = lapTimer.pointLineSegmentDistance(crossingLat, crossingLng, a.lat, a.lng, b.lat, b.lng);
+  check(offLine <= 0.1 * gap + 1e-3, linear ? "linear crossing on the line" : "Catmull-Rom crossing on the line", iteration, describe("%.6fm off the line, %.6fm gap", offLine, gap));
+}
+
+int main(int argc, char **argv) {
+  int iterations = 20000;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--seed" && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--iterations" && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--seed N] [--iterations N]\n", argv[0]);
+      return 2;
+    }
+  }
+  rng.seed(seed);
+
+  DovesLapTimer lapTimer;
+  for (int i = 0; i < iterations; i++) {
+    haversineProperties(lapTimer, i);
+    lineProperties(lapTimer, i);
+    interpolationProperties(lapTimer, i, false);
+    interpolationProperties(lapTimer, i, true);
+  }
+
+  printf("%d iterations with seed %lu, %d failures\n", iterations, seed, failures);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * Checks the track database reader against a database built by extras/trackdb/build_trackdb.py from trackdb_test.json.
+ *
+ * Usage: doves_track_database_test trackdb_test.bin
+ *
+ * Covers the lookup of the track under a fix (neighbouring cells, both sides of the antimeridian, overlapping tracks),
+ * the track and layout records, the lines a layout loads into the lap timer, and reads failing part way.
+ * Exits with 0 if every check passes.
+ */
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include "DovesTrackDatabase.h"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &what) {
+  if (!condition) {
+    printf("FAILED %s\n", what.c_str());
+    failures++;
+  }
+}
+
+// the database stores degrees * 1e7
+static bool sameDegrees(double a, double b) {
+  return fabs(a - b) < 1e-7;
+}
+
+static int trackNamed(DovesTrackDatabase &database, const char *name) {
+  dovesTrackInfo info;
+  for (int i = 0; i < database.getTrackCount(); i++) {
+    if (database.getTrack(i, info) && strcmp(info.name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void checkFindTrack(DovesTrackDatabase &database, double lat, double lng, const char *expected) {
+  int found = database.findTrack(lat, lng);
+  dovesTrackInfo info;
+  const char *name = database.getTrack(found, info) ? info.name : "no track";
+  char what[160];
+  snprintf(what, sizeof(what), "findTrack(%.4f, %.4f) is %s, not %s", lat, lng, name, expected ? expected : "no track");
+  check(expected == nullptr ? found == -1 : strcmp(name, expected) == 0, what);
+}
+
+static void checkLine(DovesLapTimer &lapTimer, int lineIndex, double aLat, double aLng, double bLat, double bLng, timingLineType type, crossingDirection direction) {
+  timingLine line;
+  std::string what = "line " + std::to_string(lineIndex);
+  if (!lapTimer.getTimingLine(lineIndex, line)) {
+    check(false, what + " missing");
+    return;
+  }
+  check(sameDegrees(line.pointALat, aLat) && sameDegrees(line.pointALng, aLng) && sameDegrees(line.pointBLat, bLat) && sameDegrees(line.pointBLng, bLng), what + " points");
+  check(line.type == type, what + " type");
+  check(line.direction == direction, what + " direction");
+}
+
+// reads through the memory reader, failing every read once the budget runs out
+struct failingReader {
+  const std::vector<uint8_t> *data;
+  int readsLeft;
+};
+
+static bool readFailing(void *context, uint32_t offset, void *buffer, size_t length) {
+  failingReader *reader = (failingReader *)context;
+  if (reader->readsLeft == 0 || offset > reader->data->size() || length > reader->data->size() - offset) {
+    return false;
+  }
+  reader->readsLeft--;
+  memcpy(buffer, reader->data->data() + offset, length);
+  return true;
+}
+
+static bool readFile(void *context, uint32_t offset, void *buffer, size_t length) {
+  FILE *file = (FILE *)context;
+  return fseek(file, offset, SEEK_SET) == 0 && fread(buffer, 1, length, file) == length;
+}
+
+static void checkLookups(DovesTrackDatabase &database) {
+  check(database.getTrackCount() == 6, "track count");
+
+  checkFindTrack(database, 28.4127, -81.3797, "Orlando Kart Center");
+  checkFindTrack(database, 28.4121 + 0.02, -81.3797, nullptr); // 2.2km north, outside its 1.5km radius
+  checkFindTrack(database, 0, 0, nullptr);
+  // tracks indexed in the cell across the antimeridian, both ways
+  checkFindTrack(database, -16.8, 179.995, "East Of Antimeridian");
+  checkFindTrack(database, -16.2, -179.995, "West Of Antimeridian");
+  // indexed in the diagonal neighbour of the fix's cell
+  checkFindTrack(database, 40.2501, 10.2501, "Cell Corner");
+  checkFindTrack(database, 40.2497, 10.2497, "Cell Corner");
+  // both in range, the closest one wins
+  checkFindTrack(database, 51.108, 1.10, "Neighbour North");
+  checkFindTrack(database, 51.102, 1.10, "Neighbour South");
+
+  int orlando = trackNamed(database, "Orlando Kart Center");
+  dovesTrackInfo track;
+  check(database.getTrack(orlando, track), "getTrack");
+  check(sameDegrees(track.centerLat, 28.4121941) && sameDegrees(track.centerLng, -81.3796807), "track center");
+  check(track.radiusMeters == 1500 && track.layoutCount == 2, "track radius and layout count");
+  check(!database.getTrack(-1, track) && !database.getTrack(database.getTrackCount(), track), "getTrack out of range");
+
+  dovesLayoutInfo layout;
+  check(database.getLayout(orlando, 0, layout) && strcmp(layout.name, "Normal") == 0 && layout.lineCount == 2, "first layout");
+  // names are cut to fit, terminator included
+  check(database.getLayout(orlando, 1, layout) && strcmp(layout.name, "Pit Lane Layout With A ") == 0 && layout.lineCount == 3, "second layout");
+  check(!database.getLayout(orlando, 2, layout) && !database.getLayout(orlando, -1, layout), "getLayout out of range");
+
+  DovesLapTimer lapTimer;
+  check(database.loadLayout(orlando, 0, lapTimer) == 2 && lapTimer.getTimingLineCount() == 2, "loadLayout line count");
+  checkLine(lapTimer, 0, 28.41272398509636, -81.37961173507423, 28.412712209918887, -81.37971443944673, DOVES_LINE_START_FINISH, DOVES_DIRECTION_ANY);
+  checkLine(lapTimer, 1, 28.4115, -81.3790, 28.4116, -81.3791, DOVES_LINE_SPLIT, DOVES_DIRECTION_NEGATIVE_TO_POSITIVE);
+
+  // loading another layout replaces every line
+  check(database.loadLayout(orlando, 1, lapTimer) == 3, "loadLayout of the second layout");
+  checkLine(lapTimer, 0, 28.41272398509636, -81.37961173507423, 28.412712209918887, -81.37971443944673, DOVES_LINE_START_FINISH, DOVES_DIRECTION_POSITIVE_TO_NEGATIVE);
+  checkLine(lapTimer, 1, 28.4120, -81.3800, 28.4121, -81.3801, DOVES_LINE_PIT_IN, DOVES_DIRECTION_ANY);
+  checkLine(lapTimer, 2, 28.4125, -81.3802, 28.4126, -81.3803, DOVES_LINE_PIT_OUT, DOVES_DIRECTION_ANY);
+
+  int stage = trackNamed(database, "East Of Antimeridian");
+  check(database.loadLayout(stage, 0, lapTimer) == 2, "loadLayout of a point-to-point stage");
+  checkLine(lapTimer, 0, -16.80, -179.991, -16.80, -179.990, DOVES_LINE_START, DOVES_DIRECTION_ANY);
+  checkLine(lapTimer, 1, -16.81, -179.989, -16.81, -179.988, DOVES_LINE_FINISH, DOVES_DIRECTION_ANY);
+
+  check(database.loadLayout(orlando, 2, lapTimer) == -1 && lapTimer.getTimingLineCount() == 2, "loadLayout of a missing layout keeps the lines");
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s trackdb_test.bin\n", argv[0]);
+    return 2;
+  }
+  FILE *file = fopen(argv[1], "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "can't open %s\n", argv[1]);
+    return 2;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t length;
+  while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + length);
+  }
+
+  // memory-mapped, and through a reader like a file on an SD card
+  DovesTrackDatabase database;
+  check(database.begin(data.data(), data.size()), "begin from memory");
+  checkLookups(database);
+  DovesTrackDatabase fileDatabase;
+  check(fileDatabase.begin(readFile, file), "begin from a file");
+  checkLookups(fileDatabase);
+
+  DovesTrackDatabase broken;
+  std::vector<uint8_t> badMagic = data;
+  badMagic[0] = 'X';
+  check(!broken.begin(badMagic.data(), badMagic.size()) && broken.getTrackCount() == 0, "begin with a bad magic");
+  check(!broken.begin(data.data(), 8), "begin with a truncated header");
+  check(broken.findTrack(28.4127, -81.3797) == -1, "findTrack without a database");
+
+  // the lines of the last layout are the last bytes, cut into them
+  int orlando = trackNamed(database, "Orlando Kart Center");
+  int corner = trackNamed(database, "Cell Corner");
+  int neighbour = trackNamed(database, "Neighbour North");
+  DovesLapTimer lapTimer;
+  DovesTrackDatabase truncated;
+  check(truncated.begin(data.data(), data.size() - 10), "begin with truncated lines");
+  check(truncated.loadLayout(orlando, 0, lapTimer) == 2, "loadLayout before the truncation");
+  check(truncated.loadLayout(neighbour, 0, lapTimer) == -1, "loadLayout of truncated lines fails");
+  checkLine(lapTimer, 1, 28.4115, -81.3790, 28.4116, -81.3791, DOVES_LINE_SPLIT, DOVES_DIRECTION_NEGATIVE_TO_POSITIVE);
+
+  // a reader failing on the second read of the lines, while they are replaced, leaves none rather than some
+  failingReader reader = {&data, -1};
+  DovesTrackDatabase flaky;
+  check(flaky.begin(readFailing, &reader), "begin through a failing reader");
+  check(flaky.loadLayout(corner, 0, lapTimer) == 1, "loadLayout through a failing reader");
+  reader.readsLeft = 2 + 3 + 1; // track and layout records, the first pass, one line of the second pass
+  check(flaky.loadLayout(orlando, 1, lapTimer) == -1 && lapTimer.getTimingLineCount() == 0, "loadLayout failing half way clears the lines");
+
+  fclose(file);
+  printf("%d failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * Runs the unit test sketch natively, against the library built with DOVES_UNIT_TEST so the full suite runs.
+ *
+ * Usage: doves_unit_test [--known-failure name ...] [name ...]
+ *
+ * Without names every test runs. A known failure is reported but does not fail the run,
+ * it does fail once it passes, so the list can't go stale.
+ * Exits with 0 if every test ran as expected.
+ */
+
+#include <set>
+#include <string>
+#include <stdio.h>
+#include "../../examples/unit_test/unit_test.ino"
+
+int main(int argc, char **argv) {
+  std::set<std::string> knownFailures;
+  std::set<std::string> selected;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--known-failure" && i + 1 < argc) {
+      knownFailures.insert(argv[++i]);
+    } else if (arg.compare(0, 2, "--") == 0) {
+      fprintf(stderr, "usage: %s [--known-failure name ...] [name ...]\n", argv[0]);
+      return 2;
+    } else {
+      selected.insert(arg);
+    }
+  }
+
+  setupTestLine();
+
+  int run = 0;
+  int unexpected = 0;
+  for (const Test &test : tests) {
+    if (!selected.empty() && selected.count(test.name) == 0) {
+      continue;
+    }
+    run++;
+    bool passed = runTest(test);
+    bool known = knownFailures.count(test.name) > 0;
+    if (passed && known) {
+      printf("UNEXPECTED PASS %s, remove it from the known failures\n", test.name);
+      unexpected++;
+    } else if (!passed && known) {
+      printf("known failure   %s\n", test.name);
+    } else if (!passed) {
+      printf("FAILED          %s\n", test.name);
+      unexpected++;
+    }
+  }
+
+  if (run == 0) {
+    fprintf(stderr, "no test matches the given names\n");
+    return 2;
+  }
+  printf("%d tests, %d unexpected results\n", run, unexpected);
+  return unexpected > 0 ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Builds a DovesLapTimer track database from a JSON description of venues.
+
+The output is the compact binary format read by DovesTrackDatabase (see src/DovesTrackDatabase.h),
+either as a raw .bin for an SD card, or as a C header to keep it in flash.
+
+  python3 build_trackdb.py tracks.json tracks.bin
+  python3 build_trackdb.py tracks.json track_db.h
+
+JSON layout:
+  [
+    {
+      "name": "Orlando Kart Center",
+      "lat": 28.4121, "lng": -81.3797,        # optional, defaults to the average of every line point
+      "radius": 2000,                          # meters, how far from the center a fix still matches this venue,
+                                               # at most a grid cell wide (about 24km at 30 degrees of latitude, 14km at 60)
+      "layouts": [
+        {
+          "name": "Normal",
+          "lines": [
+            { "type": "start_finish", "a": [28.412723, -81.379611], "b": [28.412712, -81.379714], "direction": 0 }
+          ]
+        }
+      ]
+    }
+  ]
+
+Line types: start_finish, split, start, finish, pit_in, pit_out (same as timingLineType).
+Direction: 0 any, 1 negative to positive, -1 positive to negative (same as crossingDirection).
+"""
+import json
+import math
+import struct
+import sys
+
+MAGIC = b"DLTD"
+VERSION = 1
+HEADER_SIZE = 16
+INDEX_ENTRY_SIZE = 8
+TRACK_SIZE = 40
+LAYOUT_SIZE = 32
+LINE_SIZE = 20
+NAME_SIZE = 24
+CELLS_PER_DEGREE = 4
+METERS_PER_DEGREE = math.radians(1.0) * 6371000.0
+LINE_TYPES = {"start_finish": 0, "split": 1, "start": 2, "finish": 3, "pit_in": 4, "pit_out": 5}
+
+
+def fixed(degrees):
+    return int(round(degrees * 1e7))
+
+
+def cell_key(lat, lng):
+    lat_cell = int(math.floor((lat + 90.0) * CELLS_PER_DEGREE))
+    lng_cell = int(math.floor((lng + 180.0) * CELLS_PER_DEGREE)) % (360 * CELLS_PER_DEGREE)
+    return (lat_cell << 16) | lng_cell
+
+
+def max_radius(lat):
+    # the reader only searches the cells next to the one under a fix, a track must not reach further than a cell width,
+    # measured at the latitude of its edge closest to the pole where the cells are narrowest
+    cell_degrees = 1.0 / CELLS_PER_DEGREE
+    return int(cell_degrees * METERS_PER_DEGREE * math.cos(math.radians(min(90.0, abs(lat) + cell_degrees))))
+
+
+def name_bytes(name):
+    raw = name.encode("utf-8")[:NAME_SIZE - 1]
+    return raw + b"\0" * (NAME_SIZE - len(raw))
+
+
+def build(tracks):
+    layout_count = sum(len(t["layouts"]) for t in tracks)
+    index_offset = HEADER_SIZE
+    track_offset = index_offset + INDEX_ENTRY_SIZE * len(tracks)
+    layout_offset = track_offset + TRACK_SIZE * len(tracks)
+    line_offset = layout_offset + LAYOUT_SIZE * layout_count
+
+    index, track_table, layout_table, line_table = [], b"", b"", b""
+    for track_index, track in enumerate(tracks):
+        points = [p for layout in track["layouts"] for line in layout["lines"] for p in (line["a"], line["b"])]
+        lat = track.get("lat", sum(p[0] for p in points) / max(len(points), 1))
+        lng = track.get("lng", sum(p[1] for p in points) / max(len(points), 1))
+        index.append((cell_key(lat, lng), track_index))
+        radius = int(track.get("radius", 2000))
+        if radius > max_radius(lat):
+            sys.exit("%s: radius %dm is larger than the %dm a track can reach from its grid cell at this latitude"
+                     % (track["name"], radius, max_radius(lat)))
+
+        first_layout = layout_offset + len(layout_table)
+        for layout in track["layouts"]:
+            first_line = line_offset + len(line_table)
+            for line in layout["lines"]:
+                line_table += struct.pack("<iiiiBbH", fixed(line["a"][0]), fixed(line["a"][1]), fixed(line["b"][0]), fixed(line["b"][1]),
+                                          LINE_TYPES[line.get("type", "start_finish")], int(line.get("direction", 0)), 0)
+            layout_table += name_bytes(layout["name"]) + struct.pack("<BBHI", len(layout["lines"]), 0, 0, first_line)
+
+        track_table += struct.pack("<iiHBBI", fixed(lat), fixed(lng), radius, len(track["layouts"]), 0, first_layout)
+        track_table += name_bytes(track["name"])
+
+    index.sort()
+    index_table = b"".join(struct.pack("<IHH", key, track_index, 0) for key, track_index in index)
+    header = MAGIC + struct.pack("<HHII", VERSION, len(tracks), index_offset, track_offset)
+    return header + index_table + track_table + layout_table + line_table
+
+
+def as_header(data):
+    lines = ["// Generated by extras/trackdb/build_trackdb.py, do not edit", "#ifndef _DOVES_TRACK_DB_H", "#define _DOVES_TRACK_DB_H",
+             "const uint8_t doves_track_db[] = {"]
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines += ["};", "#endif", ""]
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__)
+        sys.exit(1)
+    with open(sys.argv[1]) as f:
+        data = build(json.load(f))
+    if sys.argv[2].endswith(".h"):
+        with open(sys.argv[2], "w") as f:
+            f.write(as_header(data))
+    else:
+        with open(sys.argv[2], "wb") as f:
+            f.write(data)
+    print("wrote %d bytes" % len(data))
+
+
+if __name__ == "__main__":
+    main()
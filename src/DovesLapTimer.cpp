@@ -8,62 +8,143 @@
 
 #include "DovesLapTimer.h"
 
+// traces above DOVES_TRACE_LEVEL expand to nothing, so their arguments are never evaluated
+#if DOVES_TRACE_LEVEL >= 1
 #define debugln debug_println
 #define debug debug_print
+#else
+#define debugln(...) do {} while (0)
+#define debug(...) do {} while (0)
+#endif
+// per fix traces, only at level 2
+#if DOVES_TRACE_LEVEL >= 2
+#define traceln debug_println
+#define trace debug_print
+#else
+#define traceln(...) do {} while (0)
+#define trace(...) do {} while (0)
+#endif
+
+static_assert(DOVES_MAX_TIMING_LINES <= 32, "timing line grid buckets are 32 bit masks");
+static_assert((DOVES_LINE_GRID_BUCKETS & (DOVES_LINE_GRID_BUCKETS - 1)) == 0, "DOVES_LINE_GRID_BUCKETS must be a power of two");
+static_assert(sizeof(dovesPackedLap) == 2 * sizeof(doves_time_t) + 8, "lap history records should pack to 2 times plus 8 bytes");
+
+#if DOVES_TRACE_RING_SIZE > 0
+static_assert(sizeof(dovesTraceEvent) == 12, "trace events should pack to 12 bytes");
+#define traceEvent(type, time, line, index, value) recordTraceEvent(type, time, line, index, value)
+#else
+#define traceEvent(...) do {} while (0)
+#endif
+#ifdef DOVES_PROFILE
+// times the rest of the scope it is declared in
+struct dovesProfileScope {
+  DovesLapTimer *timer;
+  uint8_t stage;
+  unsigned long start;
+  dovesProfileScope(DovesLapTimer *timer, uint8_t stage) : timer(timer), stage(stage), start(timer->profileClock()) {}
+  ~dovesProfileScope() {
+    timer->recordStageTime(stage, (uint32_t)(timer->profileClock() - start));
+  }
+};
+#define profileStage(stage) dovesProfileScope stageScope(this, stage)
+#else
+#define profileStage(stage) do {} while (0)
+#endif
+// distances in the trace ring are in millimeters
+#define DOVES_TRACE_MM(meters) ((int32_t)((meters) * 1000))
+
+// rounds an interpolated time offset to the nearest time unit, negative offsets wrap like any other unsigned time subtraction
+static doves_time_t roundTime(double offset) {
+  return (doves_time_t)(int64_t)floor(offset + 0.5);
+}
+// same for odometer offsets in millimeters
+static uint32_t roundMillimeters(double offset) {
+  return (uint32_t)(int64_t)floor(offset + 0.5);
+}
+#define DOVES_MICROS_PER_SECOND 1000000UL
+// GPS time units per local microsecond, with a perfect crystal
+#define DOVES_NOMINAL_CLOCK_RATE ((float)DOVES_TIME_UNITS_PER_SECOND / DOVES_MICROS_PER_SECOND)
+
+// the local counter the extrapolated clock runs on, micros() so PPS edges keep their precision in millisecond builds
+static unsigned long localTime() {
+  return micros();
+}
 
 DovesLapTimer::DovesLapTimer(double crossingThresholdMeters, Stream *debugSerial) {
   this->crossingThresholdMeters = crossingThresholdMeters;
 
+  #if DOVES_TRACE_LEVEL > 0
   if (debugSerial == NULL) {
     _serial = nullptr;
   } else {
     _serial = debugSerial;
   }
+  #else
+  (void)debugSerial;
+  #endif
+  clearLapStatistics();
+  #ifdef DOVES_PROFILE
+  resetProfile();
+  #endif
 }
 
 int DovesLapTimer::loop(double currentLat, double currentLng, float currentAltitudeMeters, float currentSpeedKnots) {
-  // Update Odometer
-  double distanceTraveledSinceLastUpdate = this->haversine3D(
-    posistionPrevLat,
-    posistionPrevLng,
-    posistionPrevAlt,
-    currentLat,
-    currentLng,
-    currentAltitudeMeters
-  );
-  posistionPrevLat = currentLat;
-  posistionPrevLng = currentLng;
-  posistionPrevAlt = currentAltitudeMeters;
-  totalDistanceTraveled += distanceTraveledSinceLastUpdate;
-
+  profileStage(DOVES_STAGE_LOOP);
   // update current speed
   currentSpeedkmh = currentSpeedKnots * 1.852;
 
+  // Update Odometer, stationary or imprecise fixes only wander around the last counted position so don't even measure them
+  bool stationary = currentSpeedkmh < odometerMinSpeedKmh;
+  bool imprecise = odometerMaxHdop > 0 && currentHdop > odometerMaxHdop;
+  if (!stationary && !imprecise) {
+    double distanceTraveledSinceLastUpdate = this->haversine3D(
+      posistionPrevLat,
+      posistionPrevLng,
+      posistionPrevAlt,
+      currentLat,
+      currentLng,
+      currentAltitudeMeters
+    );
+    // small moves stay measured from the same position, so a slow creep still adds up
+    bool firstFix = posistionPrevLat == 0 || posistionPrevLng == 0;
+    if (firstFix || distanceTraveledSinceLastUpdate >= odometerDeadbandMeters) {
+      posistionPrevLat = currentLat;
+      posistionPrevLng = currentLng;
+      posistionPrevAlt = currentAltitudeMeters;
+      totalDistanceMillimeters += roundMillimeters(distanceTraveledSinceLastUpdate * 1000);
+    }
+  }
+
   // run calculations for each crossing-line
-  if (this->checkStartFinish(currentLat, currentLng)) {
+  bool nearLine = this->checkCrossingLines(currentLat, currentLng);
+
+  // after the check, a lap completed by this fix already counts it as part of the next lap
+  if (raceStarted) {
+    currentLapTopSpeed = std::max(currentLapTopSpeed, currentSpeedkmh);
+    currentLapMinSpeed = std::min(currentLapMinSpeed, currentSpeedkmh);
+
+    #if DOVES_DELTA_MAX_SAMPLES > 0
+    double x, y;
+    projectToLocal(currentLat, currentLng, x, y);
+    recordDeltaTrace(x, y);
+    matchReferencePosition(x, y);
+    #endif
+  }
+
+  if (nearLine) {
     return 0;
   } else {
     return -1;
   }
 }
 
-// TODO: update function to be a bit more portable to allow for split timing
-bool DovesLapTimer::checkStartFinish(double currentLat, double currentLng) {
-  // // dbg
-  // double tempDist = pointLineSegmentDistance(currentLat, currentLng, startFinishPointALat, startFinishPointALng, startFinishPointBLat, startFinishPointBLng);
-  // if (tempDist < crossingThresholdMeters) {
-  //   bool isObt = isObtuseTriangle(currentLat, currentLng, startFinishPointALat, startFinishPointALng, startFinishPointBLat, startFinishPointBLng);
-  //   bool insideFancyTriangle = insideLineThreshold(currentLat, currentLng, startFinishPointALat, startFinishPointALng, startFinishPointBLat, startFinishPointBLng);
-  //   debug(" | distToLine: ");
-  //   debug(tempDist);
-  //   debug(" | isObtuseTriangle: ");
-  //   debug(isObt ? "True" : "False");
-  //   debug(" | insideFancyTriangle: ");
-  //   debugln(insideFancyTriangle ? "True" : "False");
-  // }
-  // return false;
-  // // dbg
+int DovesLapTimer::loop(double currentLat, double currentLng, float currentAltitudeMeters, float currentSpeedKnots, doves_time_t fixTime) {
+  // the position and its time are stored together in the crossing buffer
+  updateCurrentTime(fixTime);
+  return loop(currentLat, currentLng, currentAltitudeMeters, currentSpeedKnots);
+}
 
+bool DovesLapTimer::checkCrossingLines(double currentLat, double currentLng) {
   double distToLine = INFINITY;
   /**
    * I don't believe this will be entirely great for the long term... let me explain...
@@ -84,93 +165,115 @@ bool DovesLapTimer::checkStartFinish(double currentLat, double currentLng) {
    * This calculated hypotnuse is now the new "threshold" of sorts
    * We then "draw" a line from the driver to each of the crossing points
    * If either line drawn is longer than the hypotnuse, we are not in the "crossingThreshold"
+   *
+   * Only the lines registered in our grid cell are candidates, so fixes far from every line cost a single lookup
    */
-  if (crossing || insideLineThreshold(currentLat, currentLng, startFinishPointALat, startFinishPointALng, startFinishPointBLat, startFinishPointBLng)) {
-    distToLine = pointLineSegmentDistance(currentLat, currentLng, startFinishPointALat, startFinishPointALng, startFinishPointBLat, startFinishPointBLng);
+  if (crossing) {
+    const timingLine& line = timingLines[crossingLineIndex];
+    distToLine = pointLineSegmentDistance(currentLat, currentLng, line.pointALat, line.pointALng, line.pointBLat, line.pointBLng);
+  } else if (timingLineCount > 0) {
+    double x, y;
+    projectToLocal(currentLat, currentLng, x, y);
+    uint32_t candidates = lineGrid[lineGridBucket((long)floor(x / DOVES_LINE_GRID_CELL_METERS), (long)floor(y / DOVES_LINE_GRID_CELL_METERS))] & armedLines;
+
+    bool nearIgnoredLine = false;
+    while (candidates) {
+      int lineIndex = __builtin_ctz(candidates);
+      candidates &= candidates - 1;
+
+      const timingLine& line = timingLines[lineIndex];
+      if (insideLineThreshold(currentLat, currentLng, line.pointALat, line.pointALng, line.pointBLat, line.pointBLng)) {
+        distToLine = pointLineSegmentDistance(currentLat, currentLng, line.pointALat, line.pointALng, line.pointBLat, line.pointBLng);
+        if (distToLine < crossingThresholdMeters) {
+          if (lineIndex == ignoredLineIndex) {
+            nearIgnoredLine = true;
+            distToLine = INFINITY;
+            continue;
+          }
+          // already on the side we should leave on, this is a pass going the wrong way
+          if (line.direction != DOVES_DIRECTION_ANY && pointOnSideOfLine(currentLat, currentLng, line.pointALat, line.pointALng, line.pointBLat, line.pointBLng) == line.direction) {
+            distToLine = INFINITY;
+            continue;
+          }
+          crossingLineIndex = lineIndex;
+          break;
+        }
+      }
+    }
+    if (!nearIgnoredLine) {
+      ignoredLineIndex = -1;
+    }
   }
 
   if (crossing) {
     // Check if we've moved out of the threshold area
     if (distToLine > crossingThresholdMeters + 1) {
       debugln("probably crossed, lets calculate");
-      crossing = false;
 
       // Interpolate the crossing point and its time
-      double crossingLat, crossingLng, crossingOdometer;
-      unsigned long crossingTime;
-      interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, startFinishPointALat, startFinishPointALng, startFinishPointBLat, startFinishPointBLng);
-
-      debug("crossingLat: ");
-      debugln(crossingLat, 6);
-      debug("crossingLng: ");
-      debugln(crossingLng, 6);
-      debug("crossingOdometer: ");
-      debugln(crossingOdometer);
-      debug("crossingTime: ");
-      debugln(crossingTime);
-
-      if (raceStarted) {
-        // increment lap counter
-        laps++;
-        // calculate lapTime
-        unsigned long lapTime = crossingTime - currentLapStartTime;
-        double lapDistance = crossingOdometer - currentLapOdometerStart;
-        // Update the start time for the next lap
-        currentLapStartTime = crossingTime;
-        currentLapOdometerStart = crossingOdometer;
-
-        // Process the lap time (e.g., display it, store it, etc.)
-        debug("Lap Finish Time: ");
-        debug(lapTime);
-        debug(" : ");
-        debugln((double)(lapTime/1000.0), 3);
-
-        // log best and last time
-        lastLapTime = lapTime;
-        lastLapDistance = lapDistance;
-        if(bestLapTime <= 0 || lastLapTime < bestLapTime) {
-          bestLapTime = lastLapTime;
-          bestLapDistance = lastLapDistance;
-          bestLapNumber = laps;
-        }
+      const timingLine& line = timingLines[crossingLineIndex];
+      double crossingLat, crossingLng;
+      doves_time_t crossingTime;
+      uint32_t crossingOdometer;
+      if (interpolateCrossingPoint(crossingLat, crossingLng, crossingTime, crossingOdometer, line.pointALat, line.pointALng, line.pointBLat, line.pointBLng, line.direction)) {
+        debug("crossingLat: ");
+        debugln(crossingLat, 6);
+        debug("crossingLng: ");
+        debugln(crossingLng, 6);
+        debug("crossingOdometer: ");
+        debugln(crossingOdometer);
+        debug("crossingTime: ");
+        debugln(crossingTime);
+
+        handleLineCrossing(crossingLineIndex, crossingLat, crossingLng, crossingTime, crossingOdometer);
       } else {
-        currentLapStartTime = crossingTime;
-        currentLapOdometerStart = crossingOdometer;
-        raceStarted = true;
-        debugln("Race Started");
+        debugln("left the threshold without crossing the line");
+        traceEvent(DOVES_TRACE_NO_CROSSING, currentTime, crossingLineIndex, -1, DOVES_TRACE_MM(distToLine));
       }
-      // Reset the crossingPointBuffer index and full status
-      crossingPointBufferIndex = 0;
-      crossingPointBufferFull = false;
-      memset(crossingPointBuffer, 0, sizeof(crossingPointBuffer));
+
+      clearCrossingPointBuffer();
+    } else if (timingLines[crossingLineIndex].direction != DOVES_DIRECTION_ANY &&
+               distToLine > crossingClosestDistance + 1 &&
+               pointOnSideOfLine(currentLat, currentLng, timingLines[crossingLineIndex].pointALat, timingLines[crossingLineIndex].pointALng, timingLines[crossingLineIndex].pointBLat, timingLines[crossingLineIndex].pointBLng) == -timingLines[crossingLineIndex].direction) {
+      // still on the approach side but heading away from the line, no point buffering the rest of the threshold
+      debugln("moving away from the line without crossing it, stop buffering");
+      traceEvent(DOVES_TRACE_MOVING_AWAY, currentTime, crossingLineIndex, -1, DOVES_TRACE_MM(distToLine));
+      ignoredLineIndex = crossingLineIndex;
+      clearCrossingPointBuffer();
     } else {
+      crossingClosestDistance = std::min(crossingClosestDistance, distToLine);
+
       // Update the crossingPointBuffer with the current GPS fix
       crossingPointBuffer[crossingPointBufferIndex].lat = currentLat;
       crossingPointBuffer[crossingPointBufferIndex].lng = currentLng;
-      crossingPointBuffer[crossingPointBufferIndex].time = millisecondsSinceMidnight;
-      crossingPointBuffer[crossingPointBufferIndex].odometer = totalDistanceTraveled;
+      crossingPointBuffer[crossingPointBufferIndex].time = currentTime;
+      crossingPointBuffer[crossingPointBufferIndex].odometer = (uint32_t)totalDistanceMillimeters;
       crossingPointBuffer[crossingPointBufferIndex].speedKmh = currentSpeedkmh;
+      traceEvent(DOVES_TRACE_BUFFER_INSERT, currentTime, crossingLineIndex, crossingPointBufferIndex, DOVES_TRACE_MM(distToLine));
 
       crossingPointBufferIndex = (crossingPointBufferIndex + 1) % crossingPointBufferSize;
       if (crossingPointBufferIndex == 0) {
         crossingPointBufferFull = true;
       }
 
-      debug("distToLine: ");
-      debug(distToLine);
-      debug(" | crossing = true, add to crossingPointBuffer: index[");
-      debug(crossingPointBufferIndex);
-      debug("] full[");
-      debug(crossingPointBufferFull == true ? "True" : "False");
-      debug("]");
-      debug(" millisecondsSinceMidnight[");
-      debug(millisecondsSinceMidnight);
-      debugln("]");
+      trace("distToLine: ");
+      trace(distToLine);
+      trace(" | crossing = true, add to crossingPointBuffer: index[");
+      trace(crossingPointBufferIndex);
+      trace("] full[");
+      trace(crossingPointBufferFull == true ? "True" : "False");
+      trace("]");
+      trace(" currentTime[");
+      trace(currentTime);
+      traceln("]");
     }
   } else {
     if (distToLine < crossingThresholdMeters) {
-      debugln("we are possibly crossing");
+      debug("we are possibly crossing line: ");
+      debugln(crossingLineIndex);
       crossing = true;
+      crossingClosestDistance = distToLine;
+      traceEvent(DOVES_TRACE_THRESHOLD_ENTER, currentTime, crossingLineIndex, -1, DOVES_TRACE_MM(distToLine));
     }
   }
 
@@ -182,7 +285,472 @@ bool DovesLapTimer::checkStartFinish(double currentLat, double currentLng) {
   }
 }
 
+void DovesLapTimer::handleLineCrossing(int lineIndex, double crossingLat, double crossingLng, doves_time_t crossingTime, uint32_t crossingOdometer) {
+  timingLines[lineIndex].lastCrossingTime = crossingTime;
+  lastLineCrossed = lineIndex;
+
+  switch (timingLines[lineIndex].type) {
+    case DOVES_LINE_START_FINISH:
+      if (raceStarted) {
+        recordSector(lineIndex, crossingTime);
+        completeLap(crossingLat, crossingLng, crossingTime, crossingOdometer);
+      } else {
+        currentLapStartTime = crossingTime;
+        currentLapOdometerStart = crossingOdometer;
+        raceStarted = true;
+        startSectors(lineIndex, crossingTime);
+        startDeltaTrace(crossingLat, crossingLng);
+        resetLapSpeeds();
+        debugln("Race Started");
+      }
+      break;
+    case DOVES_LINE_START:
+      currentLapStartTime = crossingTime;
+      currentLapOdometerStart = crossingOdometer;
+      raceStarted = true;
+      startSectors(lineIndex, crossingTime);
+      startDeltaTrace(crossingLat, crossingLng);
+      resetLapSpeeds();
+      debugln("Run Started");
+      break;
+    case DOVES_LINE_FINISH:
+      if (raceStarted) {
+        recordSector(lineIndex, crossingTime);
+        completeLap(crossingLat, crossingLng, crossingTime, crossingOdometer);
+        raceStarted = false;
+        debugln("Run Finished");
+      }
+      break;
+    case DOVES_LINE_PIT_IN:
+      inPitLane = true;
+      pitEntryTime = crossingTime;
+      pitCount++;
+      currentLapFlags |= DOVES_LAP_IN_LAP;
+      debugln("Pit Entry");
+      break;
+    case DOVES_LINE_PIT_OUT:
+      if (inPitLane) {
+        lastPitTime = crossingTime - pitEntryTime;
+        debug("Pit Exit, pit time: ");
+        debugln(lastPitTime);
+      }
+      inPitLane = false;
+      currentLapFlags |= DOVES_LAP_OUT_LAP;
+      break;
+    default:
+      debug("Split crossed: ");
+      debugln(lineIndex);
+      if (raceStarted) {
+        recordSector(lineIndex, crossingTime);
+      }
+      break;
+  }
+  updateArmedLines();
+}
+
+void DovesLapTimer::completeLap(double crossingLat, double crossingLng, doves_time_t crossingTime, uint32_t crossingOdometer) {
+  // increment lap counter
+  laps++;
+  // calculate lapTime
+  doves_time_t lapTime = crossingTime - currentLapStartTime;
+  float lapDistance = (crossingOdometer - currentLapOdometerStart) / 1000.0f;
+  // Update the start time for the next lap
+  currentLapStartTime = crossingTime;
+  currentLapOdometerStart = crossingOdometer;
+
+  // Process the lap time (e.g., display it, store it, etc.)
+  debug("Lap Finish Time: ");
+  debug(lapTime);
+  debug(" : ");
+  debugln((double)lapTime / DOVES_TIME_UNITS_PER_SECOND, 3);
+
+  // log best and last time
+  lastLapTime = lapTime;
+  lastLapDistance = lapDistance;
+  lastLapFlags = currentLapFlags;
+  currentLapFlags = 0;
+  addLapStatistics(lapTime, lastLapFlags);
+  addLapRecord(lapTime, lapDistance, crossingTime, lastLapFlags);
+  resetLapSpeeds();
+  if(bestLapTime <= 0 || lastLapTime < bestLapTime) {
+    bestLapTime = lastLapTime;
+    bestLapDistance = lastLapDistance;
+    bestLapNumber = laps;
+
+    #if DOVES_DELTA_MAX_SAMPLES > 0
+    // the trace of this lap becomes the reference, minus the samples recorded past the line before it was detected
+    uint16_t lapSamples = (uint16_t)std::min((float)DOVES_DELTA_MAX_SAMPLES, lapDistance / DOVES_DELTA_SAMPLE_METERS + 1);
+    deltaTraceCount[deltaRecordingTrace] = std::min(deltaTraceCount[deltaRecordingTrace], lapSamples);
+    deltaRecordingTrace ^= 1;
+    #endif
+  }
+  startDeltaTrace(crossingLat, crossingLng);
+
+  if (!sectorLapPartial) {
+    learnSectors();
+  }
+  sectorLapPartial = false;
+  memset(lapSectorOpeningLines, 0, sizeof(lapSectorOpeningLines));
+  lapSectorCount = 0;
+}
+
+void DovesLapTimer::addLapRecord(doves_time_t lapTime, float lapDistance, doves_time_t crossingTime, uint8_t lapFlags) {
+  #if DOVES_LAP_HISTORY_SIZE > 0
+  lapHistoryNewest = (lapHistoryNewest + 1) % DOVES_LAP_HISTORY_SIZE;
+  lapHistoryCount = std::min(lapHistoryCount + 1, DOVES_LAP_HISTORY_SIZE);
+
+  dovesPackedLap &record = lapHistory[lapHistoryNewest];
+  record.lapTime = lapTime;
+  record.crossingTime = crossingTime;
+  record.flags = lapFlags;
+  record.distance = (uint32_t)std::min(4294967295.0, lapDistance * 10.0 + 0.5);
+  record.topSpeedKmh = (uint8_t)std::min(255.0f, currentLapTopSpeed + 0.5f);
+  record.minSpeedKmh = (uint8_t)std::min(255.0f, currentLapMinSpeed + 0.5f);
+  #else
+  (void)lapTime;
+  (void)lapDistance;
+  (void)crossingTime;
+  (void)lapFlags;
+  #endif
+}
+
+#if DOVES_TRACE_RING_SIZE > 0
+void DovesLapTimer::recordTraceEvent(uint8_t type, uint32_t time, int line, int index, int32_t value) {
+  dovesTraceEvent &event = traceRing[(traceRingHead + traceRingCount) % DOVES_TRACE_RING_SIZE];
+  if (traceRingCount == DOVES_TRACE_RING_SIZE) {
+    // full, the slot after the newest event is the oldest one
+    traceRingHead = (traceRingHead + 1) % DOVES_TRACE_RING_SIZE;
+    traceEventsDropped++;
+  } else {
+    traceRingCount++;
+  }
+  event.time = time;
+  event.type = type;
+  event.line = (uint8_t)line;
+  event.index = (int16_t)index;
+  event.value = value;
+}
+#endif
+
+#ifdef DOVES_PROFILE
+void DovesLapTimer::recordStageTime(uint8_t stage, uint32_t ticks) {
+  dovesStageProfile &profile = stageProfiles[stage];
+  profile.count++;
+  profile.total += ticks;
+  profile.min = std::min(profile.min, ticks);
+  profile.max = std::max(profile.max, ticks);
+  // bucket by the bit length of the duration
+  int bucket = ticks == 0 ? 0 : 32 - __builtin_clz(ticks);
+  profile.histogram[std::min(bucket, DOVES_PROFILE_BUCKETS - 1)]++;
+}
+#endif
+
+void DovesLapTimer::resetLapSpeeds() {
+  currentLapTopSpeed = 0;
+  currentLapMinSpeed = INFINITY;
+}
+
+void DovesLapTimer::addLapStatistics(doves_time_t lapTime, uint8_t lapFlags) {
+  if (lapFlags & statsExcludedFlags) {
+    return;
+  }
+  // only once there are a few laps to take the median of
+  if (statsOutlierRatio > 0 && statsLapCount >= 3 && lapTime > quantileValue(statsMedian) * statsOutlierRatio) {
+    debugln("Lap excluded from statistics");
+    return;
+  }
+
+  statsLapCount++;
+  double delta = lapTime - statsMean;
+  statsMean += delta / statsLapCount;
+  statsM2 += delta * (lapTime - statsMean);
+  quantileAdd(statsMedian, lapTime);
+  quantileAdd(statsP90, lapTime);
+}
+
+void DovesLapTimer::clearLapStatistics() {
+  statsLapCount = 0;
+  statsMean = 0;
+  statsM2 = 0;
+  quantileInit(statsMedian, 0.5);
+  quantileInit(statsP90, 0.9);
+}
+
+void DovesLapTimer::quantileInit(p2Quantile &estimate, double quantile) {
+  estimate.quantile = quantile;
+  estimate.count = 0;
+  for (int i = 0; i < 5; i++) {
+    estimate.positions[i] = i;
+  }
+  estimate.desiredPositions[0] = 0;
+  estimate.desiredPositions[1] = 2 * quantile;
+  estimate.desiredPositions[2] = 4 * quantile;
+  estimate.desiredPositions[3] = 2 + 2 * quantile;
+  estimate.desiredPositions[4] = 4;
+}
+
+void DovesLapTimer::quantileAdd(p2Quantile &estimate, double sample) {
+  double *heights = estimate.heights;
+  double *positions = estimate.positions;
+
+  // the first 5 samples are kept sorted as they are
+  if (estimate.count < 5) {
+    int i = estimate.count++;
+    for (; i > 0 && heights[i - 1] > sample; i--) {
+      heights[i] = heights[i - 1];
+    }
+    heights[i] = sample;
+    return;
+  }
+  estimate.count++;
+
+  // find the cell the sample falls in, stretching the outer markers if needed
+  int cell;
+  if (sample < heights[0]) {
+    heights[0] = sample;
+    cell = 0;
+  } else if (sample >= heights[4]) {
+    heights[4] = sample;
+    cell = 3;
+  } else {
+    cell = 0;
+    while (sample >= heights[cell + 1]) {
+      cell++;
+    }
+  }
+  for (int i = cell + 1; i < 5; i++) {
+    positions[i]++;
+  }
+  double q = estimate.quantile;
+  const double increments[5] = {0, q / 2, q, (1 + q) / 2, 1};
+  for (int i = 0; i < 5; i++) {
+    estimate.desiredPositions[i] += increments[i];
+  }
+
+  // move the middle markers towards their desired positions, parabolic if it keeps them ordered, linear otherwise
+  for (int i = 1; i < 4; i++) {
+    double offset = estimate.desiredPositions[i] - positions[i];
+    if ((offset >= 1 && positions[i + 1] - positions[i] > 1) || (offset <= -1 && positions[i - 1] - positions[i] < -1)) {
+      int step = offset > 0 ? 1 : -1;
+      double parabolic = heights[i] + step / (positions[i + 1] - positions[i - 1]) * (
+        (positions[i] - positions[i - 1] + step) * (heights[i + 1] - heights[i]) / (positions[i + 1] - positions[i]) +
+        (positions[i + 1] - positions[i] - step) * (heights[i] - heights[i - 1]) / (positions[i] - positions[i - 1]));
+      if (heights[i - 1] < parabolic && parabolic < heights[i + 1]) {
+        heights[i] = parabolic;
+      } else {
+        heights[i] += step * (heights[i + step] - heights[i]) / (positions[i + step] - positions[i]);
+      }
+      positions[i] += step;
+    }
+  }
+}
+
+double DovesLapTimer::quantileValue(const p2Quantile &estimate) {
+  if (estimate.count == 0) {
+    return 0;
+  }
+  if (estimate.count <= 5) {
+    return estimate.heights[(int)floor(estimate.quantile * (estimate.count - 1) + 0.5)];
+  }
+  return estimate.heights[2];
+}
+
+void DovesLapTimer::startSectors(int lineIndex, doves_time_t crossingTime) {
+  sectorStartLine = lineIndex;
+  sectorStartTime = crossingTime;
+  consecutiveSectors = 0;
+  memset(lapSectorOpeningLines, 0, sizeof(lapSectorOpeningLines));
+  lapSectorCount = 0;
+}
+
+void DovesLapTimer::recordSector(int lineIndex, doves_time_t crossingTime) {
+  doves_time_t sectorTime = crossingTime - sectorStartTime;
+  int openingLine = sectorStartLine;
+  sectorStartLine = lineIndex;
+  sectorStartTime = crossingTime;
+  if (openingLine < 0) {
+    // the lines were replaced since the last crossing, no sector ends here, the next one starts
+    consecutiveSectors = 0;
+    sectorLapPartial = true;
+    return;
+  }
+
+  // the sectors of the current lap, to learn the layout from once the lap is done
+  if (lapSectorOpeningLines[lineIndex] == 0) {
+    lapSectorCount++;
+  }
+  lapSectorOpeningLines[lineIndex] = openingLine + 1;
+  lapSectorTimes[lineIndex] = sectorTime;
+
+  if (sectorOpeningLines[lineIndex] != openingLine + 1) {
+    // a missed split merges two sectors, that time is no sector at all and breaks the run of consecutive sectors
+    consecutiveSectors = 0;
+    return;
+  }
+
+  // keep the optimal lap up to date with each improvement instead of summing it up on every call
+  doves_time_t &bestSectorTime = bestSectorTimes[lineIndex];
+  if (bestSectorTime == 0 || sectorTime < bestSectorTime) {
+    optimalLapTime = optimalLapTime - bestSectorTime + sectorTime;
+    bestSectorTime = sectorTime;
+  }
+
+  // the latest time of every sector always sums up to the lap that just ended on this sector
+  recentSectorsSum = recentSectorsSum - recentSectorTimes[lineIndex] + sectorTime;
+  recentSectorTimes[lineIndex] = sectorTime;
+  consecutiveSectors++;
+  if (sectorsLearned && consecutiveSectors >= sectorCount && (rollingBestLapTime == 0 || recentSectorsSum < rollingBestLapTime)) {
+    rollingBestLapTime = recentSectorsSum;
+  }
+}
+
+void DovesLapTimer::learnSectors() {
+  // a lap with a missed split has fewer sectors than the layout, only a lap crossing more lines (or other ones) replaces it
+  bool sameLayout = sectorsLearned && memcmp(lapSectorOpeningLines, sectorOpeningLines, sizeof(sectorOpeningLines)) == 0;
+  if (sameLayout || (sectorsLearned && lapSectorCount < sectorCount)) {
+    return;
+  }
+  debugln("Sector layout learned");
+
+  // sectors opened by the same line as before keep their best time, the others start over from this lap
+  optimalLapTime = 0;
+  recentSectorsSum = 0;
+  for (int i = 0; i < DOVES_MAX_TIMING_LINES; i++) {
+    if (lapSectorOpeningLines[i] == 0) {
+      bestSectorTimes[i] = 0;
+      recentSectorTimes[i] = 0;
+      continue;
+    }
+    if (lapSectorOpeningLines[i] != sectorOpeningLines[i] || bestSectorTimes[i] == 0 || lapSectorTimes[i] < bestSectorTimes[i]) {
+      bestSectorTimes[i] = lapSectorTimes[i];
+    }
+    recentSectorTimes[i] = lapSectorTimes[i];
+    optimalLapTime += bestSectorTimes[i];
+    recentSectorsSum += lapSectorTimes[i];
+  }
+  memcpy(sectorOpeningLines, lapSectorOpeningLines, sizeof(sectorOpeningLines));
+  sectorCount = lapSectorCount;
+  sectorsLearned = true;
+  consecutiveSectors = sectorCount;
+  if (rollingBestLapTime == 0 || recentSectorsSum < rollingBestLapTime) {
+    rollingBestLapTime = recentSectorsSum;
+  }
+}
+
+void DovesLapTimer::clearSectors() {
+  memset(bestSectorTimes, 0, sizeof(bestSectorTimes));
+  memset(recentSectorTimes, 0, sizeof(recentSectorTimes));
+  memset(sectorOpeningLines, 0, sizeof(sectorOpeningLines));
+  memset(lapSectorOpeningLines, 0, sizeof(lapSectorOpeningLines));
+  lapSectorCount = 0;
+  sectorCount = 0;
+  sectorsLearned = false;
+  sectorLapPartial = false;
+  sectorStartLine = -1;
+  consecutiveSectors = 0;
+  recentSectorsSum = 0;
+  optimalLapTime = 0;
+  rollingBestLapTime = 0;
+}
+
+void DovesLapTimer::startDeltaTrace(double crossingLat, double crossingLng) {
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  // the first sample is the crossing itself, the fixes that detected it can already be metres past the line
+  double x, y;
+  projectToLocal(crossingLat, crossingLng, x, y);
+  deltaTraceCount[deltaRecordingTrace] = 0;
+  deltaPrevDistance = 0;
+  deltaPrevTime = 0;
+  deltaPrevX = x;
+  deltaPrevY = y;
+  deltaCursor = 0;
+  positionDelta = 0;
+  #else
+  (void)crossingLat;
+  (void)crossingLng;
+  #endif
+}
+
+float DovesLapTimer::distanceSinceLapStart() const {
+  // the difference of the low bits is still right when they wrap mid lap, signed as the interpolated lap start can overshoot the last fix
+  return (int32_t)((uint32_t)totalDistanceMillimeters - currentLapOdometerStart) / 1000.0f;
+}
+
+#if DOVES_DELTA_MAX_SAMPLES > 0
+void DovesLapTimer::recordDeltaTrace(float x, float y) {
+  float lapDistance = distanceSinceLapStart();
+  uint32_t lapTime = currentTime - currentLapStartTime;
+  uint16_t &count = deltaTraceCount[deltaRecordingTrace];
+
+  // resample onto the distance grid, interpolating between the previous fix and this one
+  while (count < DOVES_DELTA_MAX_SAMPLES && (float)count * DOVES_DELTA_SAMPLE_METERS <= lapDistance) {
+    float t = 1;
+    if (lapDistance > deltaPrevDistance) {
+      t = std::max(0.0f, ((float)count * DOVES_DELTA_SAMPLE_METERS - deltaPrevDistance) / (lapDistance - deltaPrevDistance));
+    }
+    deltaTrace[deltaRecordingTrace][count] = deltaPrevTime + (uint32_t)(t * (lapTime - deltaPrevTime) + 0.5f);
+    deltaTraceX[deltaRecordingTrace][count] = deltaPrevX + t * (x - deltaPrevX);
+    deltaTraceY[deltaRecordingTrace][count] = deltaPrevY + t * (y - deltaPrevY);
+    count++;
+  }
+  deltaPrevDistance = lapDistance;
+  deltaPrevTime = lapTime;
+  deltaPrevX = x;
+  deltaPrevY = y;
+}
+
+void DovesLapTimer::matchReferencePosition(float x, float y) {
+  uint8_t referenceTrace = deltaRecordingTrace ^ 1;
+  int count = deltaTraceCount[referenceTrace];
+  if (count < 2) {
+    positionDelta = 0;
+    return;
+  }
+  const float *referenceX = deltaTraceX[referenceTrace];
+  const float *referenceY = deltaTraceY[referenceTrace];
+  const uint32_t *reference = deltaTrace[referenceTrace];
+
+  int bestSegment = 0;
+  float bestT = 0;
+  float bestDistanceSq = INFINITY;
+  for (int pass = 0; pass < 2; pass++) {
+    // only the segments around the previous match, laps move forward along the reference
+    int firstSegment = std::max(deltaCursor - 1, 0);
+    int lastSegment = std::min(deltaCursor + DOVES_DELTA_SEARCH_WINDOW, count - 2);
+    for (int i = firstSegment; i <= lastSegment; i++) {
+      float segmentX = referenceX[i + 1] - referenceX[i];
+      float segmentY = referenceY[i + 1] - referenceY[i];
+      float lengthSq = segmentX * segmentX + segmentY * segmentY;
+      float t = lengthSq > 0 ? ((x - referenceX[i]) * segmentX + (y - referenceY[i]) * segmentY) / lengthSq : 0;
+      t = std::min(std::max(t, 0.0f), 1.0f);
+      float errorX = referenceX[i] + t * segmentX - x;
+      float errorY = referenceY[i] + t * segmentY - y;
+      float distanceSq = errorX * errorX + errorY * errorY;
+      if (distanceSq < bestDistanceSq) {
+        bestDistanceSq = distanceSq;
+        bestSegment = i;
+        bestT = t;
+      }
+    }
+    if (bestDistanceSq <= sq(2 * DOVES_DELTA_SAMPLE_METERS)) {
+      break;
+    }
+    // lost the reference, e.g. after a dropout, pick it up again where the odometer says we are
+    int odometerSegment = std::min((int)(distanceSinceLapStart() / DOVES_DELTA_SAMPLE_METERS), count - 2);
+    if (odometerSegment == deltaCursor) {
+      break;
+    }
+    deltaCursor = std::max(odometerSegment, 0);
+  }
+  deltaCursor = bestSegment;
+
+  uint32_t referenceTime = reference[bestSegment] + (uint32_t)(bestT * (reference[bestSegment + 1] - reference[bestSegment]) + 0.5f);
+  positionDelta = (long)(uint32_t)(currentTime - currentLapStartTime) - (long)referenceTime;
+}
+#endif
+
 bool DovesLapTimer::insideLineThreshold(double driverLat, double driverLon, double crossingPointALat, double crossingPointALon, double crossingPointBLat, double crossingPointBLon) {
+  profileStage(DOVES_STAGE_THRESHOLD);
   // Calculate the distance from the driver to crossing points A and B
   double driverLengthA = haversine(driverLat, driverLon, crossingPointALat, crossingPointALon);
   double driverLengthB = haversine(driverLat, driverLon, crossingPointBLat, crossingPointBLon);
@@ -256,6 +824,7 @@ int DovesLapTimer::pointOnSideOfLine(double driverLat, double driverLng, double
 }
 
 double DovesLapTimer::pointLineSegmentDistance(double pointX, double pointY, double startX, double startY, double endX, double endY) {
+  profileStage(DOVES_STAGE_LINE_DISTANCE);
   double segmentLengthSquared = pow(endX - startX, 2) + pow(endY - startY, 2);
 
   if (segmentLengthSquared == 0) {
@@ -316,6 +885,96 @@ double DovesLapTimer::haversine3D(double prevLat, double prevLng, double prevAlt
 
 /////////// private functions
 
+void DovesLapTimer::clearCrossingPointBuffer() {
+  crossing = false;
+  crossingLineIndex = -1;
+  crossingClosestDistance = INFINITY;
+
+  // Reset the crossingPointBuffer index and full status
+  crossingPointBufferIndex = 0;
+  crossingPointBufferFull = false;
+  memset(crossingPointBuffer, 0, sizeof(crossingPointBuffer));
+}
+
+void DovesLapTimer::updateArmedLines() {
+  bool pointToPoint = startLineIndex >= 0;
+  armedLines = 0;
+  for (int i = 0; i < timingLineCount; i++) {
+    bool armed;
+    switch (timingLines[i].type) {
+      case DOVES_LINE_PIT_IN:
+        armed = !inPitLane;
+        break;
+      case DOVES_LINE_PIT_OUT:
+        armed = inPitLane || !raceStarted;
+        break;
+      case DOVES_LINE_START:
+        armed = !raceStarted;
+        break;
+      case DOVES_LINE_FINISH:
+        armed = raceStarted;
+        break;
+      case DOVES_LINE_SPLIT:
+        armed = !pointToPoint || raceStarted;
+        break;
+      default:
+        armed = true;
+        break;
+    }
+    // nothing but the pit exit matters while in the pit lane
+    if (inPitLane && timingLines[i].type != DOVES_LINE_PIT_OUT) {
+      armed = false;
+    }
+    if (armed) {
+      armedLines |= (uint32_t)1 << i;
+    }
+  }
+}
+
+void DovesLapTimer::projectToLocal(double lat, double lng, double& x, double& y) const {
+  // equirectangular projection around the grid origin, plenty accurate over the size of a track
+  x = (lng - gridOriginLng) * gridMetersPerDegreeLng;
+  y = (lat - gridOriginLat) * gridMetersPerDegreeLat;
+}
+unsigned int DovesLapTimer::lineGridBucket(long cellX, long cellY) const {
+  uint32_t hash = ((uint32_t)cellX * 73856093u) ^ ((uint32_t)cellY * 19349663u);
+  return hash & (DOVES_LINE_GRID_BUCKETS - 1);
+}
+void DovesLapTimer::rebuildLineGrid() {
+  memset(lineGrid, 0, sizeof(lineGrid));
+  if (timingLineCount == 0) {
+    return;
+  }
+
+  // anchor the local frame on the first line, meters per degree are fixed from here on
+  gridOriginLat = timingLines[0].pointALat;
+  gridOriginLng = timingLines[0].pointALng;
+  gridMetersPerDegreeLat = radians(1.0) * radiusEarth;
+  gridMetersPerDegreeLng = gridMetersPerDegreeLat * cos(radians(gridOriginLat));
+
+  for (int i = 0; i < timingLineCount; i++) {
+    const timingLine& line = timingLines[i];
+    double ax, ay, bx, by;
+    projectToLocal(line.pointALat, line.pointALng, ax, ay);
+    projectToLocal(line.pointBLat, line.pointBLng, bx, by);
+
+    // insideLineThreshold() can only pass within maxLineLength of both points, pad by a meter for projection error
+    double lineLength = haversine(line.pointALat, line.pointALng, line.pointBLat, line.pointBLng);
+    double reach = sqrt(sq(crossingThresholdMeters) + sq(lineLength)) + 1;
+
+    long minCellX = (long)floor((std::max(ax, bx) - reach) / DOVES_LINE_GRID_CELL_METERS);
+    long maxCellX = (long)floor((std::min(ax, bx) + reach) / DOVES_LINE_GRID_CELL_METERS);
+    long minCellY = (long)floor((std::max(ay, by) - reach) / DOVES_LINE_GRID_CELL_METERS);
+    long maxCellY = (long)floor((std::min(ay, by) + reach) / DOVES_LINE_GRID_CELL_METERS);
+
+    for (long cellX = minCellX; cellX <= maxCellX; cellX++) {
+      for (long cellY = minCellY; cellY <= maxCellY; cellY++) {
+        lineGrid[lineGridBucket(cellX, cellY)] |= (uint32_t)1 << i;
+      }
+    }
+  }
+}
+
 double DovesLapTimer::interpolateWeight(double distA, double distB, float speedA, float speedB) {
   double weightedDistA = distA / speedA;
   double weightedDistB = distB / speedB;
@@ -335,7 +994,8 @@ double DovesLapTimer::catmullRom(double p0, double p1, double p2, double p3, dou
   // Calculate and return the interpolated value using the coefficients and powers of t
   return a * t3 + b * t2 + c * t + d;
 }
-void DovesLapTimer::interpolateCrossingPoint(double& crossingLat, double& crossingLng, unsigned long& crossingTime, double& crossingOdometer, double pointALat, double pointALng, double pointBLat, double pointBLng) {
+bool DovesLapTimer::interpolateCrossingPoint(double& crossingLat, double& crossingLng, doves_time_t& crossingTime, uint32_t& crossingOdometer, double pointALat, double pointALng, double pointBLat, double pointBLng, crossingDirection direction) {
+  profileStage(DOVES_STAGE_INTERPOLATE);
   int numPoints = crossingPointBufferFull ? crossingPointBufferSize : crossingPointBufferIndex;
 
   // Variables to store the best pair of points
@@ -352,73 +1012,127 @@ void DovesLapTimer::interpolateCrossingPoint(double& crossingLat, double& crossi
     int sideA = pointOnSideOfLine(crossingPointBuffer[i].lat, crossingPointBuffer[i].lng, pointALat, pointALng, pointBLat, pointBLng);
     int sideB = pointOnSideOfLine(crossingPointBuffer[i + 1].lat, crossingPointBuffer[i + 1].lng, pointALat, pointALng, pointBLat, pointBLng);
 
-    debug("i: ");
-    debug(i);
-    debug(" : distA: ");
-    debug(distA);
-    debug(" : sideA: ");
-    debug(sideA);
-    debug(" : distB: ");
-    debug(distB);
-    debug(" sideB: ");
-    debug(sideB);
-    debug(" sum: ");
-    debugln(sumDistances, 2);
+    trace("i: ");
+    trace(i);
+    trace(" : distA: ");
+    trace(distA);
+    trace(" : sideA: ");
+    trace(sideA);
+    trace(" : distB: ");
+    trace(distB);
+    trace(" sideB: ");
+    trace(sideB);
+    trace(" sum: ");
+    traceln(sumDistances, 2);
 
     // got a weird edge case problem if we dont actually cross the line, throws off everything
 
     // Update the best pair of points if the current pair has a smaller sum of distances and the points are on opposite sides of the line
-    if (sumDistances < bestSumDistances && sideA != sideB) {
-      debug("new best sum: ");
-      debugln(sumDistances, 2);
+    // (going the configured way, if any)
+    bool crossesLine = sideA != sideB && (direction == DOVES_DIRECTION_ANY || (sideA != direction && sideB != -direction));
+    if (sumDistances < bestSumDistances && crossesLine) {
+      trace("new best sum: ");
+      traceln(sumDistances, 2);
       bestSumDistances = sumDistances;
       bestIndexA = i;
       bestIndexB = i + 1;
     }
   }
-  debug(" bestSumDistances: ");
-  debugln(bestSumDistances);
+  trace(" bestSumDistances: ");
+  traceln(bestSumDistances);
 
   // Make sure we found a valid pair of points
-  if (bestIndexA != -1 && bestIndexB != -1) {
-
-    if (forceLinear) {
-      // Interpolate the crossing point's latitude, longitude, and time using the best pair of points
-      double distA = pointLineSegmentDistance(crossingPointBuffer[bestIndexA].lat, crossingPointBuffer[bestIndexA].lng, pointALat, pointALng, pointBLat, pointBLng);
-      double distB = pointLineSegmentDistance(crossingPointBuffer[bestIndexB].lat, crossingPointBuffer[bestIndexB].lng, pointALat, pointALng, pointBLat, pointBLng);
-
-      // Compute the interpolation factor based on distance and speed
-      double t = interpolateWeight(distA, distB, crossingPointBuffer[bestIndexA].speedKmh, crossingPointBuffer[bestIndexB].speedKmh);
-
-      float deltaLat = crossingPointBuffer[bestIndexB].lat - crossingPointBuffer[bestIndexA].lat;
-      float deltaLon = crossingPointBuffer[bestIndexB].lng - crossingPointBuffer[bestIndexA].lng;
-      float deltaOdometer = crossingPointBuffer[bestIndexB].odometer - crossingPointBuffer[bestIndexA].odometer;
-      float deltaTime = crossingPointBuffer[bestIndexB].time - crossingPointBuffer[bestIndexA].time;
-
-      // Preform linear interpolation
-      crossingLat = crossingPointBuffer[bestIndexA].lat + t * deltaLat;
-      crossingLng = crossingPointBuffer[bestIndexA].lng + t * deltaLon;
-      crossingOdometer = crossingPointBuffer[bestIndexA].odometer + t * deltaOdometer;  
-      crossingTime = crossingPointBuffer[bestIndexA].time + t * deltaTime;
-    } else {
-      // Define the four control points for Catmull-Rom spline interpolation
-      int index0 = bestIndexA - 1;
-      int index1 = bestIndexA;
-      int index2 = bestIndexB;
-      int index3 = bestIndexB + 1;
-
-      // Compute the interpolation factor based on distance
-      double distA = pointLineSegmentDistance(crossingPointBuffer[index1].lat, crossingPointBuffer[index1].lng, pointALat, pointALng, pointBLat, pointBLng);
-      double distB = pointLineSegmentDistance(crossingPointBuffer[index2].lat, crossingPointBuffer[index2].lng, pointALat, pointALng, pointBLat, pointBLng);
-      double t = interpolateWeight(distA, distB, crossingPointBuffer[index1].speedKmh, crossingPointBuffer[index2].speedKmh);
-
-      // Perform Catmull-Rom spline interpolation for latitude, longitude, time, and odometer
-      crossingLat = catmullRom(crossingPointBuffer[index0].lat, crossingPointBuffer[index1].lat, crossingPointBuffer[index2].lat, crossingPointBuffer[index3].lat, t);
-      crossingLng = catmullRom(crossingPointBuffer[index0].lng, crossingPointBuffer[index1].lng, crossingPointBuffer[index2].lng, crossingPointBuffer[index3].lng, t);
-      crossingTime = catmullRom(crossingPointBuffer[index0].time, crossingPointBuffer[index1].time, crossingPointBuffer[index2].time, crossingPointBuffer[index3].time, t);
-      crossingOdometer = catmullRom(crossingPointBuffer[index0].odometer, crossingPointBuffer[index1].odometer, crossingPointBuffer[index2].odometer, crossingPointBuffer[index3].odometer, t);
+  if (bestIndexA == -1 || bestIndexB == -1) {
+    return false;
+  }
+  traceEvent(DOVES_TRACE_PAIR_CHOSEN, currentTime, crossingLineIndex, bestIndexA, DOVES_TRACE_MM(bestSumDistances));
+
+  if (forceLinear) {
+    // Interpolate the crossing point's latitude, longitude, and time using the best pair of points
+    double distA = pointLineSegmentDistance(crossingPointBuffer[bestIndexA].lat, crossingPointBuffer[bestIndexA].lng, pointALat, pointALng, pointBLat, pointBLng);
+    double distB = pointLineSegmentDistance(crossingPointBuffer[bestIndexB].lat, crossingPointBuffer[bestIndexB].lng, pointALat, pointALng, pointBLat, pointBLng);
+
+    // Compute the interpolation factor based on distance and speed
+    double t = interpolateWeight(distA, distB, crossingPointBuffer[bestIndexA].speedKmh, crossingPointBuffer[bestIndexB].speedKmh);
+
+    float deltaLat = crossingPointBuffer[bestIndexB].lat - crossingPointBuffer[bestIndexA].lat;
+    float deltaLon = crossingPointBuffer[bestIndexB].lng - crossingPointBuffer[bestIndexA].lng;
+    uint32_t deltaOdometer = crossingPointBuffer[bestIndexB].odometer - crossingPointBuffer[bestIndexA].odometer;
+    double deltaTime = (double)(crossingPointBuffer[bestIndexB].time - crossingPointBuffer[bestIndexA].time);
+
+    // Preform linear interpolation
+    crossingLat = crossingPointBuffer[bestIndexA].lat + t * deltaLat;
+    crossingLng = crossingPointBuffer[bestIndexA].lng + t * deltaLon;
+    crossingOdometer = crossingPointBuffer[bestIndexA].odometer + roundMillimeters(t * deltaOdometer);
+    crossingTime = crossingPointBuffer[bestIndexA].time + roundTime(t * deltaTime);
+    traceEvent(DOVES_TRACE_CROSSING, crossingTime, crossingLineIndex, (int)(t * 10000), crossingOdometer);
+  } else {
+    // Define the four control points for Catmull-Rom spline interpolation, repeating the end points at the edges of the buffer
+    int index0 = std::max(bestIndexA - 1, 0);
+    int index1 = bestIndexA;
+    int index2 = bestIndexB;
+    int index3 = std::min(bestIndexB + 1, numPoints - 1);
+
+    // Compute the interpolation factor based on distance
+    double distA = pointLineSegmentDistance(crossingPointBuffer[index1].lat, crossingPointBuffer[index1].lng, pointALat, pointALng, pointBLat, pointBLng);
+    double distB = pointLineSegmentDistance(crossingPointBuffer[index2].lat, crossingPointBuffer[index2].lng, pointALat, pointALng, pointBLat, pointBLng);
+    double t = interpolateWeight(distA, distB, crossingPointBuffer[index1].speedKmh, crossingPointBuffer[index2].speedKmh);
+
+    // Perform Catmull-Rom spline interpolation for latitude, longitude, time, and odometer
+    crossingLat = catmullRom(crossingPointBuffer[index0].lat, crossingPointBuffer[index1].lat, crossingPointBuffer[index2].lat, crossingPointBuffer[index3].lat, t);
+    crossingLng = catmullRom(crossingPointBuffer[index0].lng, crossingPointBuffer[index1].lng, crossingPointBuffer[index2].lng, crossingPointBuffer[index3].lng, t);
+    // times are interpolated relative to index1, absolute times would lose their low digits in a float or double
+    doves_time_t time1 = crossingPointBuffer[index1].time;
+    double timeOffset = catmullRom(-(double)(time1 - crossingPointBuffer[index0].time), 0, (double)(crossingPointBuffer[index2].time - time1), (double)(crossingPointBuffer[index3].time - time1), t);
+    crossingTime = time1 + roundTime(timeOffset);
+    // so is the odometer
+    uint32_t odometer1 = crossingPointBuffer[index1].odometer;
+    double odometerOffset = catmullRom(-(double)(odometer1 - crossingPointBuffer[index0].odometer), 0, (double)(crossingPointBuffer[index2].odometer - odometer1), (double)(crossingPointBuffer[index3].odometer - odometer1), t);
+    crossingOdometer = odometer1 + roundMillimeters(odometerOffset);
+    traceEvent(DOVES_TRACE_CROSSING, crossingTime, crossingLineIndex, (int)(t * 10000), crossingOdometer);
+  }
+
+  return true;
+}
+
+void DovesLapTimer::anchorClock() {
+  unsigned long now = localTime();
+  if (ppsReceived && now - ppsEdgeLocal < 2 * DOVES_MICROS_PER_SECOND) {
+    // PPS disciplined, the edge marks the start of a GPS second far more precisely than the arrival of a sentence does
+    if (ppsEdgePending) {
+      doves_time_t secondFraction = sessionTime % DOVES_TIME_UNITS_PER_SECOND;
+      doves_time_t secondStart = currentTime - secondFraction;
+      // a sentence can arrive after the edge of the next second, the time since the edge is then shorter than its fraction
+      if ((now - ppsEdgeLocal) * clockRate < secondFraction) {
+        secondStart += DOVES_TIME_UNITS_PER_SECOND;
+      }
+      clockAnchorLocal = ppsEdgeLocal;
+      clockAnchorTime = secondStart;
+      clockAnchored = true;
+      ppsEdgePending = false;
     }
+    return;
   }
+
+  if (!clockAnchored) {
+    clockWindowLocal = now;
+    clockWindowTime = currentTime;
+    clockAnchored = true;
+  }
+
+  unsigned long windowLength = now - clockWindowLocal;
+  if (windowLength >= 10 * DOVES_MICROS_PER_SECOND) {
+    float rate = (float)(currentTime - clockWindowTime) / windowLength;
+    // gaps or jumps in GPS time are not drift, a crystal stays well within 0.1%
+    if (rate > DOVES_NOMINAL_CLOCK_RATE * 0.999f && rate < DOVES_NOMINAL_CLOCK_RATE * 1.001f) {
+      clockRate = rate;
+    }
+    clockWindowLocal = now;
+    clockWindowTime = currentTime;
+  }
+
+  clockAnchorLocal = now;
+  clockAnchorTime = currentTime;
 }
 
 /////////// getters and setters
@@ -430,32 +1144,185 @@ void DovesLapTimer::reset() {
   currentLapStartTime = 0;
   lastLapTime = 0;
   bestLapTime = 0;
-  currentLapOdometerStart = 0.0;
+  currentLapOdometerStart = 0;
   lastLapDistance = 0.0;
   bestLapDistance = 0.0;
   bestLapNumber = 0;
   laps = 0;
 
+  // reset pit lane
+  inPitLane = false;
+  pitEntryTime = 0;
+  lastPitTime = 0;
+  pitCount = 0;
+  currentLapFlags = 0;
+  lastLapFlags = 0;
+
+  clearSectors();
+  clearLapStatistics();
+  #if DOVES_LAP_HISTORY_SIZE > 0
+  lapHistoryNewest = -1;
+  lapHistoryCount = 0;
+  #endif
+
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  // reset live delta
+  deltaTraceCount[0] = 0;
+  deltaTraceCount[1] = 0;
+  #endif
+
   // reset odometer?
-  totalDistanceTraveled = 0;
+  totalDistanceMillimeters = 0;
   posistionPrevLat = 0;
   posistionPrevLng = 0;
   posistionPrevAlt = 0;
   
   // Reset the crossingPointBuffer index and full status
-  crossing = false;
-  crossingPointBufferIndex = 0;
-  crossingPointBufferFull = false;
-  memset(crossingPointBuffer, 0, sizeof(crossingPointBuffer));
+  lastLineCrossed = -1;
+  for (int i = 0; i < timingLineCount; i++) {
+    timingLines[i].lastCrossingTime = 0;
+  }
+  updateArmedLines();
+  ignoredLineIndex = -1;
+  clearCrossingPointBuffer();
 }
 void DovesLapTimer::setStartFinishLine(double pointALat, double pointALng, double pointBLat, double pointBLng) {
-  startFinishPointALat = pointALat;
-  startFinishPointALng = pointALng;
-  startFinishPointBLat = pointBLat;
-  startFinishPointBLng = pointBLng;
+  setNamedLine(startFinishLineIndex, pointALat, pointALng, pointBLat, pointBLng, DOVES_LINE_START_FINISH);
+}
+void DovesLapTimer::setStartLine(double pointALat, double pointALng, double pointBLat, double pointBLng) {
+  setNamedLine(startLineIndex, pointALat, pointALng, pointBLat, pointBLng, DOVES_LINE_START);
+}
+void DovesLapTimer::setFinishLine(double pointALat, double pointALng, double pointBLat, double pointBLng) {
+  setNamedLine(finishLineIndex, pointALat, pointALng, pointBLat, pointBLng, DOVES_LINE_FINISH);
+}
+void DovesLapTimer::setPitEntryLine(double pointALat, double pointALng, double pointBLat, double pointBLng) {
+  setNamedLine(pitEntryLineIndex, pointALat, pointALng, pointBLat, pointBLng, DOVES_LINE_PIT_IN);
+}
+void DovesLapTimer::setPitExitLine(double pointALat, double pointALng, double pointBLat, double pointBLng) {
+  setNamedLine(pitExitLineIndex, pointALat, pointALng, pointBLat, pointBLng, DOVES_LINE_PIT_OUT);
 }
-void DovesLapTimer::updateCurrentTime(unsigned long currentTimeMilliseconds) {
-  millisecondsSinceMidnight = currentTimeMilliseconds;
+void DovesLapTimer::setNamedLine(int& lineIndex, double pointALat, double pointALng, double pointBLat, double pointBLng, timingLineType type) {
+  if (lineIndex < 0) {
+    lineIndex = addTimingLine(pointALat, pointALng, pointBLat, pointBLng, type);
+    return;
+  }
+  timingLine& line = timingLines[lineIndex];
+  line.pointALat = pointALat;
+  line.pointALng = pointALng;
+  line.pointBLat = pointBLat;
+  line.pointBLng = pointBLng;
+  clearSectors();
+  rebuildLineGrid();
+}
+int DovesLapTimer::addTimingLine(double pointALat, double pointALng, double pointBLat, double pointBLng, timingLineType type) {
+  if (timingLineCount >= DOVES_MAX_TIMING_LINES) {
+    debugln("Too many timing lines");
+    return -1;
+  }
+  timingLine& line = timingLines[timingLineCount];
+  line.pointALat = pointALat;
+  line.pointALng = pointALng;
+  line.pointBLat = pointBLat;
+  line.pointBLng = pointBLng;
+  line.lastCrossingTime = 0;
+  line.type = type;
+  line.direction = defaultDirection;
+  timingLineCount++;
+
+  // the sectors change with the lines, relearn them from the next full lap
+  clearSectors();
+  rebuildLineGrid();
+  updateArmedLines();
+  return timingLineCount - 1;
+}
+void DovesLapTimer::setLineDirection(int lineIndex, crossingDirection direction) {
+  if (lineIndex >= 0 && lineIndex < timingLineCount) {
+    timingLines[lineIndex].direction = direction;
+  }
+}
+void DovesLapTimer::setCrossingDirection(crossingDirection direction) {
+  defaultDirection = direction;
+  for (int i = 0; i < timingLineCount; i++) {
+    timingLines[i].direction = direction;
+  }
+}
+void DovesLapTimer::clearTimingLines() {
+  timingLineCount = 0;
+  startFinishLineIndex = -1;
+  startLineIndex = -1;
+  finishLineIndex = -1;
+  pitEntryLineIndex = -1;
+  pitExitLineIndex = -1;
+  inPitLane = false;
+  armedLines = 0;
+  lastLineCrossed = -1;
+  ignoredLineIndex = -1;
+  clearCrossingPointBuffer();
+  clearSectors();
+  rebuildLineGrid();
+}
+void DovesLapTimer::updateCurrentTime(doves_time_t gpsTime) {
+  // anything more than half a period backwards is the clock wrapping around, not a late sentence
+  doves_time_t halfPeriod = timeRolloverPeriod / 2;
+  if (gpsTimeReceived && gpsTime + halfPeriod < lastGpsTime) {
+    timeRolloverOffset += timeRolloverPeriod;
+    debugln("GPS time rolled over");
+  } else if (timeRolloverOffset >= timeRolloverPeriod && gpsTime > lastGpsTime + halfPeriod) {
+    // late sentence from before the last rollover, place it in the previous period and keep our reference
+    sessionTime = timeRolloverOffset - timeRolloverPeriod + gpsTime;
+    currentTime = (doves_time_t)sessionTime;
+    return;
+  }
+  lastGpsTime = gpsTime;
+  gpsTimeReceived = true;
+
+  sessionTime = timeRolloverOffset + gpsTime;
+  currentTime = (doves_time_t)sessionTime;
+  anchorClock();
+}
+void DovesLapTimer::setTimeRolloverPeriod(doves_time_t period) {
+  timeRolloverPeriod = period;
+}
+uint64_t DovesLapTimer::getSessionTime() const {
+  return sessionTime;
+}
+void DovesLapTimer::ppsEdge(unsigned long localMicros) {
+  if (ppsReceived) {
+    // measure the local counter against whole GPS seconds, skipping over missed pulses
+    unsigned long interval = localMicros - ppsEdgeLocal;
+    unsigned long seconds = (interval + DOVES_MICROS_PER_SECOND / 2) / DOVES_MICROS_PER_SECOND;
+    if (seconds >= 1 && seconds <= 10) {
+      float microsPerSecond = (float)interval / seconds;
+      if (microsPerSecond > DOVES_MICROS_PER_SECOND * 0.999f && microsPerSecond < DOVES_MICROS_PER_SECOND * 1.001f) {
+        clockRate = DOVES_TIME_UNITS_PER_SECOND / microsPerSecond;
+      }
+    }
+  }
+  ppsEdgeLocal = localMicros;
+  ppsEdgePending = true;
+  ppsReceived = true;
+}
+doves_time_t DovesLapTimer::getGpsTimeAt(unsigned long localMicros) const {
+  if (!clockAnchored) {
+    return currentTime;
+  }
+  // signed, the local time may be slightly before the anchor, and 32 bits like micros() so its wrap cancels out
+  int32_t elapsed = (int32_t)(uint32_t)(localMicros - clockAnchorLocal);
+  return clockAnchorTime + roundTime(elapsed * clockRate);
+}
+doves_time_t DovesLapTimer::getEstimatedTime() const {
+  if (!clockAnchored) {
+    return currentTime;
+  }
+  doves_time_t estimate = getGpsTimeAt(localTime());
+
+  // a fix arriving later than the counter predicted would step the clock back, hold it until it catches up
+  doves_time_t backwards = lastEstimatedTime - estimate;
+  if (backwards > 0 && backwards < DOVES_TIME_UNITS_PER_SECOND) {
+    return lastEstimatedTime;
+  }
+  lastEstimatedTime = estimate;
+  return estimate;
 }
 void DovesLapTimer::forceLinearInterpolation() {
   forceLinear = true;
@@ -469,23 +1336,59 @@ bool DovesLapTimer::getRaceStarted() const {
 bool DovesLapTimer::getCrossing() const {
   return crossing;
 }
-unsigned long DovesLapTimer::getCurrentLapStartTime() const {
+int DovesLapTimer::getCrossingLine() const {
+  return crossing ? crossingLineIndex : -1;
+}
+int DovesLapTimer::getTimingLineCount() const {
+  return timingLineCount;
+}
+bool DovesLapTimer::getTimingLine(int lineIndex, timingLine &line) const {
+  if (lineIndex < 0 || lineIndex >= timingLineCount) {
+    return false;
+  }
+  line = timingLines[lineIndex];
+  return true;
+}
+doves_time_t DovesLapTimer::getLineCrossingTime(int lineIndex) const {
+  return lineIndex < 0 || lineIndex >= timingLineCount ? 0 : timingLines[lineIndex].lastCrossingTime;
+}
+int DovesLapTimer::getLastLineCrossed() const {
+  return lastLineCrossed;
+}
+doves_time_t DovesLapTimer::getCurrentLapStartTime() const {
   return currentLapStartTime;
 }
-unsigned long DovesLapTimer::getCurrentLapTime() const {
-  return currentLapStartTime <= 0 || raceStarted == false ? 0 : millisecondsSinceMidnight - currentLapStartTime;
+doves_time_t DovesLapTimer::getCurrentLapTime() const {
+  return currentLapStartTime <= 0 || raceStarted == false ? 0 : currentTime - currentLapStartTime;
+}
+doves_time_t DovesLapTimer::getRunningLapTime() const {
+  return currentLapStartTime <= 0 || raceStarted == false ? 0 : getEstimatedTime() - currentLapStartTime;
 }
-unsigned long DovesLapTimer::getLastLapTime() const {
+doves_time_t DovesLapTimer::getOptimalLapTime() const {
+  return sectorsLearned ? optimalLapTime : 0;
+}
+doves_time_t DovesLapTimer::getRollingBestLapTime() const {
+  return rollingBestLapTime;
+}
+doves_time_t DovesLapTimer::getBestSectorTime(int lineIndex) const {
+  if (lineIndex < 0 || lineIndex >= timingLineCount) {
+    return 0;
+  }
+  return bestSectorTimes[lineIndex];
+}
+doves_time_t DovesLapTimer::getLastLapTime() const {
   return lastLapTime;
 }
-unsigned long DovesLapTimer::getBestLapTime() const {
+doves_time_t DovesLapTimer::getBestLapTime() const {
   return bestLapTime;
 }
 float DovesLapTimer::getCurrentLapOdometerStart() const {
-  return currentLapOdometerStart;
+  // only the low bits are kept, step back from the full odometer, signed as the interpolated lap start can overshoot the last fix
+  int64_t lapStart = (int64_t)totalDistanceMillimeters - (int32_t)((uint32_t)totalDistanceMillimeters - currentLapOdometerStart);
+  return std::max(lapStart, (int64_t)0) / 1000.0;
 }
 float DovesLapTimer::getCurrentLapDistance() const {
-  return currentLapOdometerStart == 0 || raceStarted == false ? 0 : totalDistanceTraveled - currentLapOdometerStart;
+  return currentLapOdometerStart == 0 || raceStarted == false ? 0 : distanceSinceLapStart();
 }
 float DovesLapTimer::getLastLapDistance() const {
   return lastLapDistance;
@@ -494,7 +1397,10 @@ float DovesLapTimer::getBestLapDistance() const {
   return bestLapDistance;
 }
 float DovesLapTimer::getTotalDistanceTraveled() const {
-  return totalDistanceTraveled;
+  return totalDistanceMillimeters / 1000.0;
+}
+uint64_t DovesLapTimer::getTotalDistanceMillimeters() const {
+  return totalDistanceMillimeters;
 }
 int DovesLapTimer::getBestLapNumber() const {
   return bestLapNumber;
@@ -503,8 +1409,8 @@ int DovesLapTimer::getLaps() const {
   return laps;
 }
 float DovesLapTimer::getPaceDifference() const {
-  float currentLapDistance = currentLapOdometerStart == 0 || raceStarted == false ? 0 : totalDistanceTraveled - currentLapOdometerStart;
-  unsigned long currentLapTime = millisecondsSinceMidnight - currentLapStartTime;
+  float currentLapDistance = getCurrentLapDistance();
+  doves_time_t currentLapTime = currentTime - currentLapStartTime;
 
   // Avoid division by zero
   if (currentLapDistance == 0 || bestLapDistance == 0) {
@@ -519,4 +1425,163 @@ float DovesLapTimer::getPaceDifference() const {
   float paceDiff = currentLapPace - bestLapPace;
 
   return paceDiff;  
+}
+long DovesLapTimer::getDeltaToBest() const {
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  uint8_t referenceTrace = deltaRecordingTrace ^ 1;
+  uint16_t count = deltaTraceCount[referenceTrace];
+  if (!raceStarted || count == 0) {
+    return 0;
+  }
+
+  // the trace is indexed by distance, so the sample is found directly instead of searched for
+  float position = std::max(0.0f, distanceSinceLapStart() / DOVES_DELTA_SAMPLE_METERS);
+  int index = (int)position;
+  const uint32_t *reference = deltaTrace[referenceTrace];
+  uint32_t referenceTime;
+  if (index >= count - 1) {
+    referenceTime = reference[count - 1];
+  } else {
+    referenceTime = reference[index] + (uint32_t)((position - index) * (reference[index + 1] - reference[index]) + 0.5f);
+  }
+  return (long)(uint32_t)(currentTime - currentLapStartTime) - (long)referenceTime;
+  #else
+  return 0;
+  #endif
+}
+long DovesLapTimer::getPositionDeltaToBest() const {
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  return raceStarted ? positionDelta : 0;
+  #else
+  return 0;
+  #endif
+}
+doves_time_t DovesLapTimer::getPredictedLapTime() const {
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  if (!raceStarted || deltaTraceCount[deltaRecordingTrace ^ 1] < 2) {
+    return 0;
+  }
+  // elapsed + (best lap - best lap time at the match) is the best lap plus the gap, already updated by the last fix
+  return bestLapTime + positionDelta;
+  #else
+  return 0;
+  #endif
+}
+int DovesLapTimer::getLapHistoryCount() const {
+  #if DOVES_LAP_HISTORY_SIZE > 0
+  return lapHistoryCount;
+  #else
+  return 0;
+  #endif
+}
+bool DovesLapTimer::getLapRecord(int age, dovesLapRecord &record) const {
+  #if DOVES_LAP_HISTORY_SIZE > 0
+  if (age < 0 || age >= lapHistoryCount) {
+    return false;
+  }
+  const dovesPackedLap &packed = lapHistory[(lapHistoryNewest + DOVES_LAP_HISTORY_SIZE - age) % DOVES_LAP_HISTORY_SIZE];
+  record.lapNumber = laps - age;
+  record.lapTime = packed.lapTime;
+  record.distanceMeters = packed.distance / 10.0f;
+  record.crossingTime = packed.crossingTime;
+  record.topSpeedKmh = packed.topSpeedKmh;
+  record.minSpeedKmh = packed.minSpeedKmh;
+  record.flags = packed.flags;
+  return true;
+  #else
+  (void)age;
+  (void)record;
+  return false;
+  #endif
+}
+bool DovesLapTimer::getLapRecordByNumber(int lapNumber, dovesLapRecord &record) const {
+  return getLapRecord(laps - lapNumber, record);
+}
+#if DOVES_TRACE_RING_SIZE > 0
+int DovesLapTimer::getTraceEventCount() const {
+  return traceRingCount;
+}
+bool DovesLapTimer::readTraceEvent(dovesTraceEvent &event) {
+  if (traceRingCount == 0) {
+    return false;
+  }
+  event = traceRing[traceRingHead];
+  traceRingHead = (traceRingHead + 1) % DOVES_TRACE_RING_SIZE;
+  traceRingCount--;
+  return true;
+}
+uint32_t DovesLapTimer::getTraceEventsDropped() const {
+  return traceEventsDropped;
+}
+#endif
+#ifdef DOVES_PROFILE
+void DovesLapTimer::setProfileClock(dovesProfileClock clock) {
+  profileClock = clock;
+  resetProfile();
+}
+bool DovesLapTimer::getStageProfile(int stage, dovesStageProfile &profile) const {
+  if (stage < 0 || stage >= DOVES_STAGE_COUNT) {
+    return false;
+  }
+  profile = stageProfiles[stage];
+  profile.mean = profile.count == 0 ? 0 : (float)profile.total / profile.count;
+  return true;
+}
+void DovesLapTimer::resetProfile() {
+  memset(stageProfiles, 0, sizeof(stageProfiles));
+  for (int i = 0; i < DOVES_STAGE_COUNT; i++) {
+    stageProfiles[i].min = UINT32_MAX;
+  }
+}
+#endif
+void DovesLapTimer::setOdometerGate(float minSpeedKmh, float maxHdop, float deadbandMeters) {
+  odometerMinSpeedKmh = minSpeedKmh;
+  odometerMaxHdop = maxHdop;
+  odometerDeadbandMeters = deadbandMeters;
+}
+void DovesLapTimer::updateHdop(float hdop) {
+  currentHdop = hdop;
+}
+void DovesLapTimer::setLapStatsExclusions(uint8_t excludedFlags, float outlierRatio) {
+  statsExcludedFlags = excludedFlags;
+  statsOutlierRatio = outlierRatio;
+}
+int DovesLapTimer::getStatsLapCount() const {
+  return statsLapCount;
+}
+float DovesLapTimer::getMeanLapTime() const {
+  return statsMean;
+}
+float DovesLapTimer::getLapTimeStdDev() const {
+  return statsLapCount < 2 ? 0 : sqrt(statsM2 / (statsLapCount - 1));
+}
+float DovesLapTimer::getLapConsistency() const {
+  if (statsLapCount < 2 || statsMean <= 0) {
+    return 100;
+  }
+  return 100 * (1 - getLapTimeStdDev() / statsMean);
+}
+doves_time_t DovesLapTimer::getMedianLapTime() const {
+  return (doves_time_t)(quantileValue(statsMedian) + 0.5);
+}
+doves_time_t DovesLapTimer::getP90LapTime() const {
+  return (doves_time_t)(quantileValue(statsP90) + 0.5);
+}
+bool DovesLapTimer::getInPitLane() const {
+  return inPitLane;
+}
+int DovesLapTimer::getPitCount() const {
+  return pitCount;
+}
+doves_time_t DovesLapTimer::getLastPitTime() const {
+  return lastPitTime;
+}
+doves_time_t DovesLapTimer::getCurrentPitTime() const {
+  return inPitLane ? currentTime - pitEntryTime : 0;
+}
+uint8_t DovesLapTimer::getCurrentLapFlags() const {
+  return currentLapFlags;
+}
+uint8_t DovesLapTimer::getLastLapFlags() const {
+  return lastLapFlags;
 }
\ No newline at end of file
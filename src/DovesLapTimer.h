@@ -14,17 +14,207 @@
 #include <math.h>
 #include "Arduino.h"
 #include <algorithm>
+#include <stdint.h>
+
+// Number of fixes buffered while crossing a line, 28 bytes each (32 with DOVES_MICROSECOND_TIME), 20 seconds at 25Hz
+#ifndef DOVES_CROSSING_BUFFER_SIZE
+#ifdef DOVES_UNIT_TEST
+#define DOVES_CROSSING_BUFFER_SIZE 300
+#else
+#define DOVES_CROSSING_BUFFER_SIZE 500
+#endif
+#endif
+
+// Maximum number of timing lines (start/finish, splits, ...) that can be registered, at most 32
+#ifndef DOVES_MAX_TIMING_LINES
+#define DOVES_MAX_TIMING_LINES 16
+#endif
+// Size of a single cell of the timing line lookup grid, in meters
+#ifndef DOVES_LINE_GRID_CELL_METERS
+#define DOVES_LINE_GRID_CELL_METERS 25.0
+#endif
+// Number of hash buckets backing the timing line lookup grid, must be a power of two
+#ifndef DOVES_LINE_GRID_BUCKETS
+#define DOVES_LINE_GRID_BUCKETS 64
+#endif
+// Distance between the samples of the time-vs-distance traces behind the live delta, in meters
+#ifndef DOVES_DELTA_SAMPLE_METERS
+#define DOVES_DELTA_SAMPLE_METERS 10
+#endif
+// Samples per trace, two traces are kept (best and current lap), past samples * meters the delta holds its last reference.
+// 24 bytes per sample, 6KB at 256, 0 compiles the live delta and predicted lap time out, the default on AVR boards
+#ifndef DOVES_DELTA_MAX_SAMPLES
+#ifdef __AVR__
+#define DOVES_DELTA_MAX_SAMPLES 0
+#else
+#define DOVES_DELTA_MAX_SAMPLES 256
+#endif
+#endif
+// Reference samples searched ahead of the previous match by the position matched delta
+#ifndef DOVES_DELTA_SEARCH_WINDOW
+#define DOVES_DELTA_SEARCH_WINDOW 8
+#endif
+// Number of completed laps kept in the lap history, 16 bytes each (24 with DOVES_MICROSECOND_TIME), 0 compiles the history out
+#ifndef DOVES_LAP_HISTORY_SIZE
+#define DOVES_LAP_HISTORY_SIZE 32
+#endif
+// Fixes below this speed, above this HDOP, or closer than this to the last counted position don't add to the odometer,
+// 0 turns each gate off so every fix counts
+#ifndef DOVES_ODOMETER_MIN_SPEED_KMH
+#define DOVES_ODOMETER_MIN_SPEED_KMH 0
+#endif
+#ifndef DOVES_ODOMETER_MAX_HDOP
+#define DOVES_ODOMETER_MAX_HDOP 0
+#endif
+#ifndef DOVES_ODOMETER_DEADBAND_METERS
+#define DOVES_ODOMETER_DEADBAND_METERS 0
+#endif
+
+// Debug output written to the Stream passed to the constructor: 0 none (not even the Stream is kept),
+// 1 line crossings, laps and other events, 2 also every buffered fix and interpolation candidate.
+// Traces above the level are compiled out, arguments and all.
+#ifndef DOVES_TRACE_LEVEL
+#define DOVES_TRACE_LEVEL 1
+#endif
+
+// Number of crossing decisions kept in the binary trace ring (see readTraceEvent()), 12 bytes each, 0 compiles it out.
+// Off by default at DOVES_TRACE_LEVEL 0, so that level records nothing on the hot path, define it to keep the ring anyway.
+#ifndef DOVES_TRACE_RING_SIZE
+#if DOVES_TRACE_LEVEL > 0
+#define DOVES_TRACE_RING_SIZE 64
+#else
+#define DOVES_TRACE_RING_SIZE 0
+#endif
+#endif
+
+// Define to keep every time in microseconds instead of milliseconds, for 50Hz+ or PPS disciplined receivers.
+// Every time passed in or returned is then in microseconds where the docs say milliseconds.
+// Times become 64 bits wide, millisecond builds keep their 32 bit times.
+// #define DOVES_MICROSECOND_TIME
+#ifdef DOVES_MICROSECOND_TIME
+typedef uint64_t doves_time_t;
+#define DOVES_TIME_UNITS_PER_SECOND 1000000UL
+#else
+typedef unsigned long doves_time_t;
+#define DOVES_TIME_UNITS_PER_SECOND 1000UL
+#endif
+
+// Define to time the hot path stages (see getStageProfile()), compiles to nothing otherwise.
+// #define DOVES_PROFILE
+// Log2 buckets of the stage histograms, bucket i counts durations from 2^(i-1) up to 2^i, the last one everything longer
+#ifndef DOVES_PROFILE_BUCKETS
+#define DOVES_PROFILE_BUCKETS 16
+#endif
 
 using TRITYPE = double;
 
+enum timingLineType : uint8_t {
+  DOVES_LINE_START_FINISH = 0, // closes one lap and opens the next
+  DOVES_LINE_SPLIT = 1, // only records its crossing time, for splits and speed-traps
+  DOVES_LINE_START = 2, // point-to-point only, starts the run
+  DOVES_LINE_FINISH = 3, // point-to-point only, ends the run
+  DOVES_LINE_PIT_IN = 4, // pit lane entry
+  DOVES_LINE_PIT_OUT = 5 // pit lane exit
+};
+
+enum crossingDirection : int8_t {
+  DOVES_DIRECTION_ANY = 0, // count crossings both ways
+  DOVES_DIRECTION_NEGATIVE_TO_POSITIVE = 1, // only count going from side -1 to side 1 of pointOnSideOfLine()
+  DOVES_DIRECTION_POSITIVE_TO_NEGATIVE = -1 // only count going from side 1 to side -1 of pointOnSideOfLine()
+};
+
+enum lapFlag : uint8_t {
+  DOVES_LAP_IN_LAP = 1, // the pit lane was entered during this lap
+  DOVES_LAP_OUT_LAP = 2 // the pit lane was left during, or right before, this lap
+};
+
+enum dovesTraceEventType : uint8_t {
+  DOVES_TRACE_THRESHOLD_ENTER = 1, // value: distance to the line in mm
+  DOVES_TRACE_BUFFER_INSERT = 2, // index: buffer slot, value: distance to the line in mm
+  DOVES_TRACE_PAIR_CHOSEN = 3, // index: first buffer slot of the pair, value: sum of their distances to the line in mm
+  DOVES_TRACE_CROSSING = 4, // time: crossing time, index: interpolation weight in 1/10000, value: crossing odometer in mm
+  DOVES_TRACE_NO_CROSSING = 5, // left the threshold without a pair crossing the line, value: distance to the line in mm
+  DOVES_TRACE_MOVING_AWAY = 6 // stopped buffering heading away from the line, value: distance to the line in mm
+};
+
+// A crossing decision, recorded instead of printed so tracing doesn't change the timing of loop()
+struct dovesTraceEvent {
+  uint32_t time; // low bits of the current time, or of the crossing time
+  uint8_t type; // dovesTraceEventType
+  uint8_t line; // timing line index
+  int16_t index;
+  int32_t value;
+};
+
+enum dovesProfileStage : uint8_t {
+  DOVES_STAGE_LOOP = 0, // all of loop()
+  DOVES_STAGE_THRESHOLD = 1, // insideLineThreshold()
+  DOVES_STAGE_LINE_DISTANCE = 2, // pointLineSegmentDistance()
+  DOVES_STAGE_INTERPOLATE = 3, // interpolateCrossingPoint()
+  DOVES_STAGE_COUNT = 4
+};
+
+// Durations are in ticks of the profile clock, micros() unless setProfileClock() was called
+struct dovesStageProfile {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  float mean;
+  uint64_t total;
+  uint32_t histogram[DOVES_PROFILE_BUCKETS];
+};
+
+// Returns a free running tick count, e.g. micros() or a cycle counter
+typedef unsigned long (*dovesProfileClock)();
+
+struct timingLine {
+  double pointALat;
+  double pointALng;
+  double pointBLat;
+  double pointBLng;
+  doves_time_t lastCrossingTime; // time of the latest crossing, 0 if never crossed
+  timingLineType type;
+  crossingDirection direction;
+};
+
 struct crossingPointBufferEntry {
   double lat; // latitude
   double lng; // longitude
-  unsigned long time; // current time in milliseconds
-  float odometer; // time traveled since device start and this entry
+  doves_time_t time; // time of the fix
+  uint32_t odometer; // distance traveled in millimeters since device start and this entry, wraps like a time
   float speedKmh; // speed in kmph
 };
 
+// A lap of the lap history, as handed out
+struct dovesLapRecord {
+  int lapNumber;
+  doves_time_t lapTime;
+  float distanceMeters;
+  doves_time_t crossingTime; // when the lap was completed
+  uint8_t topSpeedKmh;
+  uint8_t minSpeedKmh;
+  uint8_t flags; // lapFlag values
+};
+
+// A lap of the lap history, as stored
+struct dovesPackedLap {
+  doves_time_t lapTime;
+  doves_time_t crossingTime;
+  uint32_t distance; // in decimeters
+  uint8_t topSpeedKmh;
+  uint8_t minSpeedKmh;
+  uint8_t flags;
+};
+
+// P-square streaming estimate of a single quantile, 5 markers stand in for every sample
+struct p2Quantile {
+  double quantile; // 0.5 for the median
+  double heights[5]; // marker values, the first samples sorted until there are 5 of them
+  double positions[5]; // marker positions, 0 based
+  double desiredPositions[5];
+  int count;
+};
+
 class DovesLapTimer {
 public:
   DovesLapTimer(double crossingThresholdMeters = 7, Stream *debugSerial = NULL);
@@ -41,6 +231,19 @@ public:
    * @param currentSpeed The current speed in knots
    */
   int loop(double currentLat, double currentLng, float currentAltitudeMeters, float currentSpeedKnots);
+  /**
+   * @brief Same as loop() above, but timestamps the position with the time of the fix itself.
+   *
+   * Use this when the fix time is parsed from the same sentence as the position, the crossing buffer then
+   * never pairs a position with a time from another (or stale) sentence, and no separate updateCurrentTime() call is needed.
+   *
+   * @param currentLat Latitude of the current position in decimal degrees.
+   * @param currentLng Longitude of the current position in decimal degrees.
+   * @param currentAltitudeMeters Altitude of the current position in meters.
+   * @param currentSpeed The current speed in knots
+   * @param fixTime GPS time of the fix since midnight in milliseconds.
+   */
+  int loop(double currentLat, double currentLng, float currentAltitudeMeters, float currentSpeedKnots, doves_time_t fixTime);
 
   /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -154,12 +357,154 @@ public:
    * @param pointBLng Longitude of point B in decimal degrees.
    */
   void setStartFinishLine(double pointALat, double pointALng, double pointBLat, double pointBLng);
+  /**
+   * @brief Sets the start line of a point-to-point course (hill-climb, autocross, rally-stage) using two points (A and B).
+   *
+   * Once a start line is set the timer runs point-to-point, only the start line is watched until it is crossed,
+   * then only the finish line (and splits) until the run ends. Do not combine with setStartFinishLine().
+   *
+   * @param pointALat Latitude of point A in decimal degrees.
+   * @param pointALng Longitude of point A in decimal degrees.
+   * @param pointBLat Latitude of point B in decimal degrees.
+   * @param pointBLng Longitude of point B in decimal degrees.
+   */
+  void setStartLine(double pointALat, double pointALng, double pointBLat, double pointBLng);
+  /**
+   * @brief Sets the finish line of a point-to-point course using two points (A and B).
+   *
+   * @param pointALat Latitude of point A in decimal degrees.
+   * @param pointALng Longitude of point A in decimal degrees.
+   * @param pointBLat Latitude of point B in decimal degrees.
+   * @param pointBLng Longitude of point B in decimal degrees.
+   */
+  void setFinishLine(double pointALat, double pointALng, double pointBLat, double pointBLng);
+  /**
+   * @brief Sets the optional pit lane entry line using two points (A and B).
+   *
+   * While in the pit lane only the pit exit line is watched, every other line is ignored.
+   *
+   * @param pointALat Latitude of point A in decimal degrees.
+   * @param pointALng Longitude of point A in decimal degrees.
+   * @param pointBLat Latitude of point B in decimal degrees.
+   * @param pointBLng Longitude of point B in decimal degrees.
+   */
+  void setPitEntryLine(double pointALat, double pointALng, double pointBLat, double pointBLng);
+  /**
+   * @brief Sets the optional pit lane exit line using two points (A and B).
+   *
+   * Also watched before the race has started, so leaving the pits at the start of a session flags the first lap as an out-lap.
+   *
+   * @param pointALat Latitude of point A in decimal degrees.
+   * @param pointALng Longitude of point A in decimal degrees.
+   * @param pointBLat Latitude of point B in decimal degrees.
+   * @param pointBLng Longitude of point B in decimal degrees.
+   */
+  void setPitExitLine(double pointALat, double pointALng, double pointBLat, double pointBLng);
+  /**
+   * @brief Registers an additional timing line (split, speed-trap...) using two points (A and B).
+   *
+   * Lines are indexed into a uniform grid in a local metric frame when registered,
+   * so each GPS fix only has to test the lines whose threshold region touches its grid cell.
+   *
+   * @param pointALat Latitude of point A in decimal degrees.
+   * @param pointALng Longitude of point A in decimal degrees.
+   * @param pointBLat Latitude of point B in decimal degrees.
+   * @param pointBLng Longitude of point B in decimal degrees.
+   * @param type What crossing this line means, see timingLineType.
+   * @return The index of the new line, or -1 if DOVES_MAX_TIMING_LINES has been reached.
+   */
+  int addTimingLine(double pointALat, double pointALng, double pointBLat, double pointBLng, timingLineType type = DOVES_LINE_SPLIT);
+  /**
+   * @brief Only count crossings of a timing line going one way.
+   *
+   * Passes the other way never start buffering, which keeps a nearby return leg from
+   * triggering the line (see turn 10 at OKC in HELPME.md).
+   *
+   * @param lineIndex Index of the line, as returned by addTimingLine().
+   * @param direction Direction crossings have to go, see crossingDirection.
+   */
+  void setLineDirection(int lineIndex, crossingDirection direction);
+  /**
+   * @brief Only count crossings of every timing line going one way.
+   *
+   * Applies to every line registered so far, and is the default for lines registered afterwards.
+   *
+   * @param direction Direction crossings have to go, see crossingDirection.
+   */
+  void setCrossingDirection(crossingDirection direction);
+  /**
+   * @brief Removes every registered timing line, including the start/finish line.
+   */
+  void clearTimingLines();
+  /**
+   * @brief Sets which fixes the odometer counts, so GPS wander while parked doesn't add distance.
+   *
+   * Every gate is off by default, setOdometerGate(3, 5, 0.1) suits a kart parked in the pits.
+   * A skipped fix isn't lost, the next counted fix measures from the last counted position.
+   *
+   * @param minSpeedKmh Fixes slower than this are treated as stationary, 0 to count every speed.
+   * @param maxHdop Fixes with a higher HDOP (see updateHdop()) are skipped, 0 to ignore HDOP.
+   * @param deadbandMeters Movement from the last counted position smaller than this is left for a later fix.
+   */
+  void setOdometerGate(float minSpeedKmh, float maxHdop, float deadbandMeters);
+  /**
+   * @brief Updates the HDOP of the next fix passed to loop(), for the odometer gate.
+   *
+   * @param hdop Horizontal dilution of precision reported by the receiver.
+   */
+  void updateHdop(float hdop);
   /**
    * @brief Updates the current GPS time since midnight.
    *
-   * @param currentTimeMilliseconds The current time in milliseconds.
+   * GPS time of day wraps at midnight UTC, every wrap is folded into a monotonic session time base,
+   * so laps spanning midnight still time correctly. Lap math keeps using the low bits of that base in a doves_time_t.
+   *
+   * @param gpsTime The current time in milliseconds.
+   */
+  void updateCurrentTime(doves_time_t gpsTime);
+  /**
+   * @brief Sets the period after which the time passed to updateCurrentTime() wraps back to 0.
+   *
+   * Defaults to a day (time since midnight), use 604800000 (ms) when feeding GPS time of week.
+   *
+   * @param period The rollover period in time units.
    */
-  void updateCurrentTime(unsigned long currentTimeMilliseconds);
+  void setTimeRolloverPeriod(doves_time_t period);
+  /**
+   * @brief Gets the monotonic session time, GPS time plus every rollover seen since the first update.
+   *
+   * @return The session time in time units.
+   */
+  uint64_t getSessionTime() const;
+  /**
+   * @brief Gets the current time extrapolated from the last GPS time with the local micros() counter.
+   *
+   * Unlike the GPS time it advances between fixes and keeps running through dropouts, it never steps backwards.
+   * The drift of the local counter against GPS time is measured over 10 second windows and corrected for,
+   * or disciplined by ppsEdge() when the receiver has a PPS line.
+   *
+   * @return The estimated current time in milliseconds, the GPS time itself until the first update.
+   */
+  doves_time_t getEstimatedTime() const;
+  /**
+   * @brief Disciplines the extrapolated clock with the PPS pulse of the receiver, marking the start of every GPS second.
+   *
+   * Capture micros() in the PPS interrupt and pass it here from the main loop, before the sentences of that second.
+   * The clock is then anchored to the edges instead of to the arrival of sentences, free of UART and parsing latency.
+   * Falls back to anchoring on sentences when no edge was seen for 2 seconds.
+   *
+   * @param localMicros micros() at the PPS edge.
+   */
+  void ppsEdge(unsigned long localMicros);
+  /**
+   * @brief Converts a local micros() timestamp to GPS time with the extrapolated clock.
+   *
+   * Useful to timestamp events, or fixes from receivers without sub-second time, by when they happened locally.
+   *
+   * @param localMicros The micros() timestamp, within 35 minutes either side of the latest GPS time (half the micros() wrap).
+   * @return The GPS time in milliseconds.
+   */
+  doves_time_t getGpsTimeAt(unsigned long localMicros) const;
   /**
    * @brief forces linear interpolation when checking crossing line
    *
@@ -182,30 +527,92 @@ public:
    * @return True if crossing the start/finish line, false otherwise.
    */
   bool getCrossing() const;
+  /**
+   * @brief Gets the timing line currently being crossed.
+   *
+   * @return The index of the line being crossed, or -1 if not crossing.
+   */
+  int getCrossingLine() const;
+  /**
+   * @brief Gets the number of registered timing lines.
+   *
+   * @return The number of registered timing lines.
+   */
+  int getTimingLineCount() const;
+  /**
+   * @brief Gets the points, type and direction of a registered timing line, e.g. to draw it.
+   *
+   * @param lineIndex Index of the line.
+   * @param line Reference to copy the line to.
+   * @return True if the line exists.
+   */
+  bool getTimingLine(int lineIndex, timingLine &line) const;
+  /**
+   * @brief Gets the time a timing line was last crossed.
+   *
+   * Subtract getCurrentLapStartTime() to get a split time.
+   *
+   * @param lineIndex Index returned by addTimingLine().
+   * @return The latest crossing time, 0 if never crossed.
+   */
+  doves_time_t getLineCrossingTime(int lineIndex) const;
+  /**
+   * @brief Gets the timing line that was crossed last.
+   *
+   * @return The index of the last line crossed, or -1 if none.
+   */
+  int getLastLineCrossed() const;
   /**
    * @brief Gets the current lap start time.
    *
    * @return The current lap start time in milliseconds.
    */
-  unsigned long getCurrentLapStartTime() const;
+  doves_time_t getCurrentLapStartTime() const;
   /**
    * @brief Gets the current lap time.
    *
    * @return The current lap time in milliseconds.
    */
-  unsigned long getCurrentLapTime() const;
+  doves_time_t getCurrentLapTime() const;
+  /**
+   * @brief Gets the current lap time from the extrapolated clock, smooth enough for a dash at any refresh rate.
+   *
+   * @return The current lap time in milliseconds.
+   */
+  doves_time_t getRunningLapTime() const;
   /**
    * @brief Gets the last lap time.
    *
    * @return The last lap time in milliseconds.
    */
-  unsigned long getLastLapTime() const;
+  doves_time_t getLastLapTime() const;
   /**
    * @brief Gets the best lap time.
    *
    * @return The best lap time in milliseconds.
    */
-  unsigned long getBestLapTime() const;
+  doves_time_t getBestLapTime() const;
+  /**
+   * @brief Gets the optimal lap, the sum of the best time of every sector.
+   *
+   * Sectors are the sections between the lap's start line, its split lines and its finish line.
+   *
+   * @return The optimal lap time in milliseconds, 0 until a lap is completed.
+   */
+  doves_time_t getOptimalLapTime() const;
+  /**
+   * @brief Gets the rolling best lap, the fastest run of consecutive sectors as long as a lap, starting at any sector.
+   *
+   * @return The rolling best lap time in milliseconds, 0 until a lap is completed.
+   */
+  doves_time_t getRollingBestLapTime() const;
+  /**
+   * @brief Gets the best time of the sector closed by a timing line.
+   *
+   * @param lineIndex Index of the split (or finish) line closing the sector.
+   * @return The best sector time in milliseconds, 0 if never timed.
+   */
+  doves_time_t getBestSectorTime(int lineIndex) const;
   /**
    * @brief Gets the current lap odometer start.
    *
@@ -236,6 +643,12 @@ public:
    * @return The total distance traveled in meters.
    */
   float getTotalDistanceTraveled() const;
+  /**
+   * @brief Gets the total distance traveled, exact however long the session.
+   *
+   * @return The total distance traveled in millimeters.
+   */
+  uint64_t getTotalDistanceMillimeters() const;
   /**
    * @brief Gets the best lap number.
    *
@@ -256,21 +669,190 @@ public:
    * value indicates that the current lap's pace is faster.
    */
   float getPaceDifference() const;
+  /**
+   * @brief Gets the live time gap to the best lap at the distance driven so far this lap.
+   *
+   * The best lap is kept as its time every DOVES_DELTA_SAMPLE_METERS, so the gap is accurate from the first corner on.
+   *
+   * @return The gap in milliseconds, negative when ahead of the best lap, 0 until a best lap exists or with DOVES_DELTA_MAX_SAMPLES 0.
+   */
+  long getDeltaToBest() const;
+  /**
+   * @brief Gets the live time gap to the best lap at the closest point of the best lap's path.
+   *
+   * Unlike getDeltaToBest() it does not drift when taking a different line than on the best lap.
+   * Each fix only searches the few samples of the best lap just ahead of the previous match.
+   *
+   * @return The gap in milliseconds, negative when ahead of the best lap, 0 until a best lap exists or with DOVES_DELTA_MAX_SAMPLES 0.
+   */
+  long getPositionDeltaToBest() const;
+  /**
+   * @brief Predicts the time of the current lap, the time so far plus what the best lap took from the matched position on.
+   *
+   * @return The predicted lap time in milliseconds, 0 until a best lap exists or with DOVES_DELTA_MAX_SAMPLES 0.
+   */
+  doves_time_t getPredictedLapTime() const;
+  /**
+   * @brief Gets the pit lane status.
+   *
+   * @return True between crossing the pit entry and pit exit lines.
+   */
+  bool getInPitLane() const;
+  /**
+   * @brief Gets the number of pit stops (pit entry crossings).
+   *
+   * @return The number of pit stops.
+   */
+  int getPitCount() const;
+  /**
+   * @brief Gets the time spent in the pit lane during the last completed pit stop.
+   *
+   * @return The time between pit entry and pit exit in milliseconds.
+   */
+  doves_time_t getLastPitTime() const;
+  /**
+   * @brief Gets the time spent in the pit lane so far.
+   *
+   * @return The time since crossing the pit entry in milliseconds, 0 if not in the pit lane.
+   */
+  doves_time_t getCurrentPitTime() const;
+  /**
+   * @brief Gets the flags of the current lap.
+   *
+   * @return Bitmask of lapFlag values.
+   */
+  uint8_t getCurrentLapFlags() const;
+  /**
+   * @brief Gets the flags of the last lap.
+   *
+   * @return Bitmask of lapFlag values.
+   */
+  uint8_t getLastLapFlags() const;
+  /**
+   * @brief Gets the number of laps in the lap history.
+   *
+   * @return The number of laps kept, at most DOVES_LAP_HISTORY_SIZE.
+   */
+  int getLapHistoryCount() const;
+  /**
+   * @brief Reads a lap from the lap history.
+   *
+   * @param age 0 for the last lap, 1 for the one before, up to getLapHistoryCount() - 1.
+   * @param record Reference to store the lap in.
+   * @return True if the lap is in the history.
+   */
+  bool getLapRecord(int age, dovesLapRecord &record) const;
+  /**
+   * @brief Reads a lap from the lap history by its number.
+   *
+   * @param lapNumber Number of the lap, 1 for the first lap.
+   * @param record Reference to store the lap in.
+   * @return True if the lap is (still) in the history.
+   */
+  bool getLapRecordByNumber(int lapNumber, dovesLapRecord &record) const;
+  /**
+   * @brief Sets which laps are left out of the lap statistics.
+   *
+   * @param excludedFlags Laps with any of these lapFlag values are left out, in and out laps by default.
+   * @param outlierRatio Laps slower than this times the median are left out, 0 (the default) keeps them all.
+   */
+  void setLapStatsExclusions(uint8_t excludedFlags, float outlierRatio);
+  /**
+   * @brief Gets the number of laps counted in the lap statistics.
+   *
+   * @return The number of laps that were not excluded.
+   */
+  int getStatsLapCount() const;
+  /**
+   * @brief Gets the mean of the counted lap times.
+   *
+   * @return The mean lap time in milliseconds.
+   */
+  float getMeanLapTime() const;
+  /**
+   * @brief Gets the sample standard deviation of the counted lap times.
+   *
+   * @return The standard deviation in milliseconds, 0 with less than 2 laps.
+   */
+  float getLapTimeStdDev() const;
+  /**
+   * @brief Gets how consistent the counted laps are, 100 minus the coefficient of variation in percent.
+   *
+   * @return The consistency in percent, 100 when every lap is the same.
+   */
+  float getLapConsistency() const;
+  /**
+   * @brief Gets the median of the counted lap times, estimated in fixed memory.
+   *
+   * @return The median lap time in milliseconds.
+   */
+  doves_time_t getMedianLapTime() const;
+  /**
+   * @brief Gets the 90th percentile of the counted lap times, estimated in fixed memory.
+   *
+   * @return The 90th percentile lap time in milliseconds.
+   */
+  doves_time_t getP90LapTime() const;
+  #if DOVES_TRACE_RING_SIZE > 0
+  /**
+   * @brief Gets the number of trace events waiting to be read.
+   *
+   * @return The number of events in the trace ring.
+   */
+  int getTraceEventCount() const;
+  /**
+   * @brief Takes the oldest event out of the trace ring, drain it while nothing time critical is going on.
+   *
+   * @param event Reference to store the event in.
+   * @return True if there was an event.
+   */
+  bool readTraceEvent(dovesTraceEvent &event);
+  /**
+   * @brief Gets the number of events overwritten before they were read.
+   *
+   * @return The number of dropped events since the start.
+   */
+  uint32_t getTraceEventsDropped() const;
+  #endif
+  #ifdef DOVES_PROFILE
+  /**
+   * @brief Sets the clock the stages are timed with, e.g. a cycle counter for finer resolution than micros().
+   *
+   * @param clock Function returning a free running tick count.
+   */
+  void setProfileClock(dovesProfileClock clock);
+  /**
+   * @brief Gets the timings of a stage of the hot path.
+   *
+   * @param stage Stage to read, see dovesProfileStage.
+   * @param profile Reference to store the count, min, max, mean and histogram of the durations in.
+   * @return True if the stage exists.
+   */
+  bool getStageProfile(int stage, dovesStageProfile &profile) const;
+  /**
+   * @brief Clears the timings of every stage.
+   */
+  void resetProfile();
+  #endif
 
   // this is kind of gross, but I love my testing
   #ifdef DOVES_UNIT_TEST
-  bool checkStartFinish(double currentLat, double currentLng);
+  bool checkCrossingLines(double currentLat, double currentLng);
   double interpolateWeight(double distA, double distB, float speedA, float speedB);
   double catmullRom(double p0, double p1, double p2, double p3, double t);
-  void interpolateCrossingPoint(double& crossingLat, double& crossingLng, unsigned long& crossingTime, double& crossingOdometer, double pointALat, double pointALng, double pointBLat, double pointBLng);
+  bool interpolateCrossingPoint(double& crossingLat, double& crossingLng, doves_time_t& crossingTime, uint32_t& crossingOdometer, double pointALat, double pointALng, double pointBLat, double pointBLng, crossingDirection direction = DOVES_DIRECTION_ANY);
+
+  void addLapStatistics(doves_time_t lapTime, uint8_t lapFlags);
+  void addLapRecord(doves_time_t lapTime, float lapDistance, doves_time_t crossingTime, uint8_t lapFlags);
 
-  static const int crossingPointBufferSize = 300;
+  static const int crossingPointBufferSize = DOVES_CROSSING_BUFFER_SIZE;
   crossingPointBufferEntry crossingPointBuffer[crossingPointBufferSize];
   int crossingPointBufferIndex = 0;
   bool crossingPointBufferFull = false;
   #endif
 
 private:
+  #if DOVES_TRACE_LEVEL > 0
   template<typename... Args>
   void debug_print(Args&&... args) {
     if(_serial) {
@@ -283,22 +865,195 @@ private:
       _serial->println(std::forward<Args>(args)...);
     }
   }
+  #ifdef DOVES_MICROSECOND_TIME
+  // the AVR core can't print 64 bit values, times are turned into text first
+  void debug_print(uint64_t value) {
+    char digits[21];
+    char *text = digits + sizeof(digits) - 1;
+    *text = '\0';
+    do {
+      *--text = '0' + value % 10;
+      value /= 10;
+    } while (value > 0);
+    debug_print((const char *)text);
+  }
+  void debug_println(uint64_t value) {
+    debug_print(value);
+    debug_println();
+  }
+  #endif
+  #endif
+
+  /**
+   * @brief Handles a completed crossing of a timing line, updating lap or split state depending on its type.
+   *
+   * @param lineIndex Index of the line that was crossed.
+   * @param crossingLat Interpolated latitude of the crossing.
+   * @param crossingLng Interpolated longitude of the crossing.
+   * @param crossingTime Interpolated crossing time in milliseconds.
+   * @param crossingOdometer Interpolated odometer at the crossing in millimeters.
+   */
+  void handleLineCrossing(int lineIndex, double crossingLat, double crossingLng, doves_time_t crossingTime, uint32_t crossingOdometer);
+  /**
+   * @brief Projects a position into the local metric frame used by the timing line grid.
+   *
+   * @param lat Latitude in decimal degrees.
+   * @param lng Longitude in decimal degrees.
+   * @param x Reference to store the east offset from the grid origin in meters.
+   * @param y Reference to store the north offset from the grid origin in meters.
+   */
+  void projectToLocal(double lat, double lng, double& x, double& y) const;
+  /**
+   * @brief Hashes a grid cell into its bucket of the timing line grid.
+   *
+   * @param cellX Column of the cell.
+   * @param cellY Row of the cell.
+   * @return Index into lineGrid.
+   */
+  unsigned int lineGridBucket(long cellX, long cellY) const;
+  /**
+   * @brief Rebuilds the timing line grid from every registered line, run whenever lines change.
+   */
+  void rebuildLineGrid();
+  /**
+   * @brief Recomputes which timing lines are watched, point-to-point courses only watch the line expected next.
+   */
+  void updateArmedLines();
+  /**
+   * @brief Adds or moves one of the single-instance lines (start/finish, start, finish).
+   *
+   * @param lineIndex Reference to the stored index of the line, -1 if not registered yet.
+   */
+  void setNamedLine(int& lineIndex, double pointALat, double pointALng, double pointBLat, double pointBLng, timingLineType type);
+  /**
+   * @brief Closes the current lap (or run), updating last and best lap stats.
+   *
+   * @param crossingLat Interpolated latitude of the crossing, where the next lap starts.
+   * @param crossingLng Interpolated longitude of the crossing.
+   * @param crossingTime Interpolated crossing time in milliseconds.
+   * @param crossingOdometer Interpolated odometer at the crossing in millimeters.
+   */
+  void completeLap(double crossingLat, double crossingLng, doves_time_t crossingTime, uint32_t crossingOdometer);
+  /**
+   * @brief Gets the distance traveled since the start of the current lap, whether or not a race is running.
+   *
+   * @return The distance in meters.
+   */
+  float distanceSinceLapStart() const;
+  #ifndef DOVES_UNIT_TEST
+  /**
+   * @brief Adds a completed lap to the lap statistics, unless it is excluded.
+   *
+   * @param lapTime The lap time in milliseconds.
+   * @param lapFlags The lapFlag values of the lap.
+   */
+  void addLapStatistics(doves_time_t lapTime, uint8_t lapFlags);
+  /**
+   * @brief Adds the lap that just completed to the lap history, overwriting the oldest lap once full.
+   */
+  void addLapRecord(doves_time_t lapTime, float lapDistance, doves_time_t crossingTime, uint8_t lapFlags);
+  #endif
+  /**
+   * @brief Starts tracking the top and minimum speed of a new lap.
+   */
+  void resetLapSpeeds();
+  #if DOVES_TRACE_RING_SIZE > 0
+  /**
+   * @brief Records an event in the trace ring, overwriting the oldest one once full.
+   */
+  void recordTraceEvent(uint8_t type, uint32_t time, int line, int index, int32_t value);
+  #endif
+  #ifdef DOVES_PROFILE
+  friend struct dovesProfileScope;
+  /**
+   * @brief Adds a duration to the timings of a stage.
+   */
+  void recordStageTime(uint8_t stage, uint32_t ticks);
+  #endif
+  /**
+   * @brief Clears the lap statistics.
+   */
+  void clearLapStatistics();
+  /**
+   * @brief Starts a P-square quantile estimate.
+   */
+  static void quantileInit(p2Quantile &estimate, double quantile);
+  /**
+   * @brief Adds a sample to a P-square quantile estimate, in constant time.
+   */
+  static void quantileAdd(p2Quantile &estimate, double sample);
+  /**
+   * @brief Gets the current value of a P-square quantile estimate, 0 without samples.
+   */
+  static double quantileValue(const p2Quantile &estimate);
+  /**
+   * @brief Starts timing the first sector of a lap (or run) that did not directly follow another lap.
+   *
+   * @param lineIndex Index of the line the lap started on.
+   * @param crossingTime Interpolated crossing time in milliseconds.
+   */
+  void startSectors(int lineIndex, doves_time_t crossingTime);
+  /**
+   * @brief Closes the current sector, updating the best sectors, the optimal lap and the rolling best lap.
+   *
+   * @param lineIndex Index of the line closing the sector.
+   * @param crossingTime Interpolated crossing time in milliseconds.
+   */
+  void recordSector(int lineIndex, doves_time_t crossingTime);
+  /**
+   * @brief Learns the sector layout from the lap just completed, if it is the first full lap or crossed lines the layout misses.
+   */
+  void learnSectors();
+  /**
+   * @brief Clears every sector time, and what was learned about the sector layout.
+   */
+  void clearSectors();
+  /**
+   * @brief Starts recording the time-vs-distance trace of a new lap.
+   *
+   * @param crossingLat Interpolated latitude of the line crossing the lap started on.
+   * @param crossingLng Interpolated longitude of the line crossing the lap started on.
+   */
+  void startDeltaTrace(double crossingLat, double crossingLng);
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  /**
+   * @brief Adds the samples passed since the previous fix to the trace of the current lap.
+   *
+   * @param x Position of the fix east of the grid origin in meters.
+   * @param y Position of the fix north of the grid origin in meters.
+   */
+  void recordDeltaTrace(float x, float y);
+  /**
+   * @brief Finds the closest point of the best lap's path to the fix, updating the position matched delta.
+   *
+   * @param x Position of the fix east of the grid origin in meters.
+   * @param y Position of the fix north of the grid origin in meters.
+   */
+  void matchReferencePosition(float x, float y);
+  #endif
+  /**
+   * @brief Stops crossing and empties the crossingPointBuffer.
+   */
+  void clearCrossingPointBuffer();
+  /**
+   * @brief Anchors the extrapolated clock to the current GPS time and the local counter, updating the drift estimate.
+   */
+  void anchorClock();
 
   #ifndef DOVES_UNIT_TEST
   /**
-   * @brief Checks if the kart is crossing the start/finish line and calculates lap time and crossing point.
+   * @brief Checks if the kart is crossing any timing line and calculates lap time and crossing point.
    *
-   * This function is responsible for detecting when the kart is crossing the start/finish line. It compares
-   * the current position to the start/finish line and, if it is within a specified threshold distance,
-   * starts saving GPS data to a buffer. When the kart moves away from the line, the function calls
+   * This function is responsible for detecting when the kart is crossing a timing line. It looks up the
+   * lines near the current position in the line grid and, if it is within a specified threshold distance
+   * of one, starts saving GPS data to a buffer. When the kart moves away from the line, the function calls
    * interpolateCrossingPoint() to calculate the precise point at which the kart crossed the line,
-   * and computes the lap time.
+   * and computes the lap or split time.
    *
    * @param currentLat Latitude of the current position in decimal degrees.
    * @param currentLng Longitude of the current position in decimal degrees.
-   * @param currentTimeMilliseconds The current time in milliseconds.
    */
-  bool checkStartFinish(double currentLat, double currentLng);
+  bool checkCrossingLines(double currentLat, double currentLng);
   /**
    * @brief Catmull-Rom spline interpolation between two points
    *
@@ -335,44 +1090,169 @@ private:
    * @param pointALng Longitude of the first point of the line in decimal degrees.
    * @param pointBLat Latitude of the second point of the line in decimal degrees.
    * @param pointBLng Longitude of the second point of the line in decimal degrees.
+   * @param direction Only consider pairs of points crossing the line this way.
+   * @return True if a pair of points crossing the line was found, the outputs are untouched otherwise.
    */
-  void interpolateCrossingPoint(double& crossingLat, double& crossingLng, unsigned long& crossingTime, double& crossingOdometer, double pointALat, double pointALng, double pointBLat, double pointBLng);
+  bool interpolateCrossingPoint(double& crossingLat, double& crossingLng, doves_time_t& crossingTime, uint32_t& crossingOdometer, double pointALat, double pointALng, double pointBLat, double pointBLng, crossingDirection direction = DOVES_DIRECTION_ANY);
   #endif
 
+  #if DOVES_TRACE_LEVEL > 0
   Stream *_serial;
+  #endif
   
-  unsigned long millisecondsSinceMidnight = -1;
+  // low bits of the session time, unsigned subtraction stays correct across its own wrap
+  doves_time_t currentTime = -1;
+  // Session time base
+  uint64_t sessionTime = 0;
+  uint64_t timeRolloverOffset = 0;
+  doves_time_t timeRolloverPeriod = (doves_time_t)86400 * DOVES_TIME_UNITS_PER_SECOND;
+  doves_time_t lastGpsTime = 0;
+  bool gpsTimeReceived = false;
+  // Extrapolated clock, the latest GPS time and micros() when it arrived (or of its PPS edge)
+  unsigned long clockAnchorLocal = 0;
+  doves_time_t clockAnchorTime = 0;
+  // start of the current drift measuring window
+  unsigned long clockWindowLocal = 0;
+  doves_time_t clockWindowTime = 0;
+  // GPS time units per local microsecond
+  float clockRate = (float)DOVES_TIME_UNITS_PER_SECOND / 1000000;
+  bool clockAnchored = false;
+  mutable doves_time_t lastEstimatedTime = 0;
+  // latest PPS edge, pending until a sentence tells which second it started
+  unsigned long ppsEdgeLocal = 0;
+  bool ppsEdgePending = false;
+  bool ppsReceived = false;
   // Timing variables
   double crossingThresholdMeters;
   bool raceStarted = false;
   bool crossing = false;
   bool forceLinear = false;
-  unsigned long currentLapStartTime = 0;
-  unsigned long lastLapTime = 0;
-  unsigned long bestLapTime = 0;
-  float currentLapOdometerStart = 0.0;
+  doves_time_t currentLapStartTime = 0;
+  doves_time_t lastLapTime = 0;
+  doves_time_t bestLapTime = 0;
+  uint32_t currentLapOdometerStart = 0; // low bits of the odometer in millimeters
   float lastLapDistance = 0.0;
   float bestLapDistance = 0.0;
   float currentSpeedkmh = 0.0;
   int bestLapNumber = 0;
   int laps = 0;
 
-  float totalDistanceTraveled = 0;
+  // Pit lane
+  bool inPitLane = false;
+  doves_time_t pitEntryTime = 0;
+  doves_time_t lastPitTime = 0;
+  int pitCount = 0;
+  uint8_t currentLapFlags = 0;
+  uint8_t lastLapFlags = 0;
+
+  #if DOVES_LAP_HISTORY_SIZE > 0
+  // Lap history ring, oldest laps are overwritten
+  dovesPackedLap lapHistory[DOVES_LAP_HISTORY_SIZE];
+  int lapHistoryNewest = -1;
+  int lapHistoryCount = 0;
+  #endif
+  float currentLapTopSpeed = 0;
+  float currentLapMinSpeed = 0;
+
+  #if DOVES_TRACE_RING_SIZE > 0
+  dovesTraceEvent traceRing[DOVES_TRACE_RING_SIZE];
+  uint16_t traceRingHead = 0;
+  uint16_t traceRingCount = 0;
+  uint32_t traceEventsDropped = 0;
+  #endif
+
+  #ifdef DOVES_PROFILE
+  dovesProfileClock profileClock = micros;
+  dovesStageProfile stageProfiles[DOVES_STAGE_COUNT];
+  #endif
+
+  // Lap statistics, Welford's running mean and variance plus quantile estimates
+  uint8_t statsExcludedFlags = DOVES_LAP_IN_LAP | DOVES_LAP_OUT_LAP;
+  float statsOutlierRatio = 0;
+  int statsLapCount = 0;
+  double statsMean = 0;
+  double statsM2 = 0;
+  p2Quantile statsMedian;
+  p2Quantile statsP90;
+
+  // Sectors, keyed by the index of the line closing them
+  doves_time_t bestSectorTimes[DOVES_MAX_TIMING_LINES] = {};
+  // latest time of every sector, their sum is the rolling lap
+  doves_time_t recentSectorTimes[DOVES_MAX_TIMING_LINES] = {};
+  // index + 1 of the line opening every sector, 0 until the sector was first timed
+  uint8_t sectorOpeningLines[DOVES_MAX_TIMING_LINES] = {};
+  int sectorCount = 0;
+  // sectors of the current lap, as above, and their times
+  uint8_t lapSectorOpeningLines[DOVES_MAX_TIMING_LINES] = {};
+  doves_time_t lapSectorTimes[DOVES_MAX_TIMING_LINES] = {};
+  int lapSectorCount = 0;
+  bool sectorsLearned = false; // a full lap of sectors was seen
+  bool sectorLapPartial = false; // the lines were replaced during the current lap, its sectors are not all known
+  int sectorStartLine = -1;
+  doves_time_t sectorStartTime = 0;
+  int consecutiveSectors = 0;
+  doves_time_t recentSectorsSum = 0;
+  doves_time_t optimalLapTime = 0;
+  doves_time_t rollingBestLapTime = 0;
+
+  #if DOVES_DELTA_MAX_SAMPLES > 0
+  // Live delta, lap time every DOVES_DELTA_SAMPLE_METERS of the current lap and of the best lap, swapped on a new best
+  uint32_t deltaTrace[2][DOVES_DELTA_MAX_SAMPLES];
+  uint16_t deltaTraceCount[2] = {0, 0};
+  uint8_t deltaRecordingTrace = 0;
+  // position of every sample in the local frame of the line grid
+  float deltaTraceX[2][DOVES_DELTA_MAX_SAMPLES];
+  float deltaTraceY[2][DOVES_DELTA_MAX_SAMPLES];
+  // lap distance, time and position of the previous fix, to interpolate samples between fixes
+  float deltaPrevDistance = 0;
+  uint32_t deltaPrevTime = 0;
+  float deltaPrevX = 0;
+  float deltaPrevY = 0;
+  // segment of the best lap matched on the previous fix, and the gap there
+  int deltaCursor = 0;
+  long positionDelta = 0;
+  #endif
+
+  // integer millimeters stay exact over any session, lap math uses the low 32 bits which wrap like a time
+  uint64_t totalDistanceMillimeters = 0;
+  float odometerMinSpeedKmh = DOVES_ODOMETER_MIN_SPEED_KMH;
+  float odometerMaxHdop = DOVES_ODOMETER_MAX_HDOP;
+  float odometerDeadbandMeters = DOVES_ODOMETER_DEADBAND_METERS;
+  float currentHdop = 0;
   float posistionPrevAlt = 0;
   double posistionPrevLat = 0;
   double posistionPrevLng = 0;
 
-  double startFinishPointALat;
-  double startFinishPointALng;
-  double startFinishPointBLat;
-  double startFinishPointBLng;
+  timingLine timingLines[DOVES_MAX_TIMING_LINES];
+  int timingLineCount = 0;
+  int startFinishLineIndex = -1;
+  int startLineIndex = -1;
+  int finishLineIndex = -1;
+  int pitEntryLineIndex = -1;
+  int pitExitLineIndex = -1;
+  // bitmask of the lines currently watched
+  uint32_t armedLines = 0;
+  crossingDirection defaultDirection = DOVES_DIRECTION_ANY;
+  // closest the driver got to the line being crossed
+  double crossingClosestDistance = INFINITY;
+  // line the driver turned away from, ignored until they leave its threshold
+  int ignoredLineIndex = -1;
+  int crossingLineIndex = -1;
+  int lastLineCrossed = -1;
+
+  // Uniform grid over the local metric frame, each bucket holds a bitmask of nearby timing lines
+  uint32_t lineGrid[DOVES_LINE_GRID_BUCKETS] = {};
+  double gridOriginLat = 0;
+  double gridOriginLng = 0;
+  double gridMetersPerDegreeLat = 0;
+  double gridMetersPerDegreeLng = 0;
 
   // Earth's radius in meters
   const double radiusEarth = 6371.0 * 1000;
 
   #ifndef DOVES_UNIT_TEST
   // Number of GPS coordinates to store in the buffer for interpolation
-  static const int crossingPointBufferSize = 500;
+  static const int crossingPointBufferSize = DOVES_CROSSING_BUFFER_SIZE;
 
   crossingPointBufferEntry crossingPointBuffer[crossingPointBufferSize];
   int crossingPointBufferIndex = 0;
@@ -0,0 +1,243 @@
+#include "DovesTrackDatabase.h"
+
+#define DOVES_TRACK_DB_HEADER_SIZE 16
+#define DOVES_TRACK_DB_INDEX_ENTRY_SIZE 8
+#define DOVES_TRACK_DB_TRACK_SIZE 40
+#define DOVES_TRACK_DB_LAYOUT_SIZE 32
+#define DOVES_TRACK_DB_LINE_SIZE 20
+#define DOVES_TRACK_DB_LNG_CELLS (360 * DOVES_TRACK_DB_CELLS_PER_DEGREE)
+
+// the database is little-endian, assemble values byte by byte so any host can read it
+static uint16_t readU16(const uint8_t *bytes) {
+  return (uint16_t)bytes[0] | ((uint16_t)bytes[1] << 8);
+}
+static uint32_t readU32(const uint8_t *bytes) {
+  return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+static double readDegrees(const uint8_t *bytes) {
+  return (int32_t)readU32(bytes) / 1e7;
+}
+static long cellRow(double lat) {
+  return (long)floor((lat + 90.0) * DOVES_TRACK_DB_CELLS_PER_DEGREE);
+}
+static long cellColumn(double lng) {
+  long column = (long)floor((lng + 180.0) * DOVES_TRACK_DB_CELLS_PER_DEGREE) % DOVES_TRACK_DB_LNG_CELLS;
+  return column < 0 ? column + DOVES_TRACK_DB_LNG_CELLS : column;
+}
+
+bool DovesTrackDatabase::begin(const uint8_t *data, uint32_t size) {
+  memoryData = data;
+  memorySize = size;
+  return begin(memoryReader, this);
+}
+
+bool DovesTrackDatabase::begin(dovesTrackDbReader reader, void *context) {
+  this->reader = reader;
+  this->readerContext = context;
+  trackCount = 0;
+
+  uint8_t header[DOVES_TRACK_DB_HEADER_SIZE];
+  if (!read(0, header, sizeof(header))) {
+    return false;
+  }
+  if (memcmp(header, "DLTD", 4) != 0 || readU16(header + 4) != DOVES_TRACK_DB_VERSION) {
+    return false;
+  }
+  trackCount = readU16(header + 6);
+  indexOffset = readU32(header + 8);
+  trackOffset = readU32(header + 12);
+  return true;
+}
+
+int DovesTrackDatabase::getTrackCount() const {
+  return trackCount;
+}
+
+int DovesTrackDatabase::findTrack(double lat, double lng) {
+  long row = cellRow(lat);
+  long column = cellColumn(lng);
+
+  int bestTrack = -1;
+  double bestDistance = INFINITY;
+
+  // tracks near the edge of a cell can be indexed in a neighbour, the 3 cells of a row are one contiguous key range
+  for (long r = std::max(row - 1, 0L); r <= row + 1; r++) {
+    long firstColumn = column - 1;
+    long lastColumn = column + 1;
+    // split the range where it wraps around the antimeridian
+    if (firstColumn < 0) {
+      searchCells(r, firstColumn + DOVES_TRACK_DB_LNG_CELLS, DOVES_TRACK_DB_LNG_CELLS - 1, lat, lng, bestTrack, bestDistance);
+      firstColumn = 0;
+    }
+    if (lastColumn >= DOVES_TRACK_DB_LNG_CELLS) {
+      searchCells(r, 0, lastColumn - DOVES_TRACK_DB_LNG_CELLS, lat, lng, bestTrack, bestDistance);
+      lastColumn = DOVES_TRACK_DB_LNG_CELLS - 1;
+    }
+    searchCells(r, firstColumn, lastColumn, lat, lng, bestTrack, bestDistance);
+  }
+  return bestTrack;
+}
+
+bool DovesTrackDatabase::getTrack(int trackIndex, dovesTrackInfo &info) {
+  uint8_t record[DOVES_TRACK_DB_TRACK_SIZE];
+  if (!readTrackRecord(trackIndex, record)) {
+    return false;
+  }
+  info.centerLat = readDegrees(record);
+  info.centerLng = readDegrees(record + 4);
+  info.radiusMeters = readU16(record + 8);
+  info.layoutCount = record[10];
+  memcpy(info.name, record + 16, DOVES_TRACK_DB_NAME_SIZE);
+  info.name[DOVES_TRACK_DB_NAME_SIZE - 1] = '\0';
+  return true;
+}
+
+bool DovesTrackDatabase::getLayout(int trackIndex, int layoutIndex, dovesLayoutInfo &info) {
+  uint8_t record[DOVES_TRACK_DB_LAYOUT_SIZE];
+  if (!readLayoutRecord(trackIndex, layoutIndex, record)) {
+    return false;
+  }
+  memcpy(info.name, record, DOVES_TRACK_DB_NAME_SIZE);
+  info.name[DOVES_TRACK_DB_NAME_SIZE - 1] = '\0';
+  info.lineCount = record[24];
+  return true;
+}
+
+int DovesTrackDatabase::loadLayout(int trackIndex, int layoutIndex, DovesLapTimer &lapTimer) {
+  uint8_t layout[DOVES_TRACK_DB_LAYOUT_SIZE];
+  if (!readLayoutRecord(trackIndex, layoutIndex, layout)) {
+    return -1;
+  }
+  int lineCount = layout[24];
+  uint32_t lineOffset = readU32(layout + 28);
+  if (lineCount > DOVES_MAX_TIMING_LINES) {
+    return -1;
+  }
+
+  // check every line can be read before touching the lap timer, a failed load keeps the lines it had
+  for (int i = 0; i < lineCount; i++) {
+    uint8_t line[DOVES_TRACK_DB_LINE_SIZE];
+    if (!read(lineOffset + (uint32_t)i * DOVES_TRACK_DB_LINE_SIZE, line, sizeof(line))) {
+      return -1;
+    }
+  }
+
+  lapTimer.clearTimingLines();
+  for (int i = 0; i < lineCount; i++) {
+    uint8_t line[DOVES_TRACK_DB_LINE_SIZE];
+    if (!read(lineOffset + (uint32_t)i * DOVES_TRACK_DB_LINE_SIZE, line, sizeof(line))) {
+      // the reader failed the second time around, no lines beat half a layout
+      lapTimer.clearTimingLines();
+      return -1;
+    }
+    double pointALat = readDegrees(line);
+    double pointALng = readDegrees(line + 4);
+    double pointBLat = readDegrees(line + 8);
+    double pointBLng = readDegrees(line + 12);
+
+    // lines are appended, so the next index is the one this line gets
+    int lineIndex = lapTimer.getTimingLineCount();
+    switch ((timingLineType)line[16]) {
+      case DOVES_LINE_START_FINISH:
+        lapTimer.setStartFinishLine(pointALat, pointALng, pointBLat, pointBLng);
+        break;
+      case DOVES_LINE_START:
+        lapTimer.setStartLine(pointALat, pointALng, pointBLat, pointBLng);
+        break;
+      case DOVES_LINE_FINISH:
+        lapTimer.setFinishLine(pointALat, pointALng, pointBLat, pointBLng);
+        break;
+      case DOVES_LINE_PIT_IN:
+        lapTimer.setPitEntryLine(pointALat, pointALng, pointBLat, pointBLng);
+        break;
+      case DOVES_LINE_PIT_OUT:
+        lapTimer.setPitExitLine(pointALat, pointALng, pointBLat, pointBLng);
+        break;
+      default:
+        lapTimer.addTimingLine(pointALat, pointALng, pointBLat, pointBLng, DOVES_LINE_SPLIT);
+        break;
+    }
+    lapTimer.setLineDirection(lineIndex, (crossingDirection)(int8_t)line[17]);
+  }
+  return lapTimer.getTimingLineCount();
+}
+
+/////////// private functions
+
+bool DovesTrackDatabase::read(uint32_t offset, void *buffer, size_t length) {
+  return reader != nullptr && reader(readerContext, offset, buffer, length);
+}
+
+bool DovesTrackDatabase::readTrackRecord(int trackIndex, uint8_t *record) {
+  if (trackIndex < 0 || trackIndex >= trackCount) {
+    return false;
+  }
+  return read(trackOffset + (uint32_t)trackIndex * DOVES_TRACK_DB_TRACK_SIZE, record, DOVES_TRACK_DB_TRACK_SIZE);
+}
+
+bool DovesTrackDatabase::readLayoutRecord(int trackIndex, int layoutIndex, uint8_t *record) {
+  uint8_t track[DOVES_TRACK_DB_TRACK_SIZE];
+  if (!readTrackRecord(trackIndex, track) || layoutIndex < 0 || layoutIndex >= track[10]) {
+    return false;
+  }
+  return read(readU32(track + 12) + (uint32_t)layoutIndex * DOVES_TRACK_DB_LAYOUT_SIZE, record, DOVES_TRACK_DB_LAYOUT_SIZE);
+}
+
+void DovesTrackDatabase::searchCells(long row, long firstColumn, long lastColumn, double lat, double lng, int &bestTrack, double &bestDistance) {
+  uint32_t lastKey = ((uint32_t)row << 16) | (uint32_t)lastColumn;
+  double metersPerDegree = radians(1.0) * 6371000.0;
+
+  for (int i = lowerBound(((uint32_t)row << 16) | (uint32_t)firstColumn); i < trackCount; i++) {
+    uint8_t entry[DOVES_TRACK_DB_INDEX_ENTRY_SIZE];
+    if (!read(indexOffset + (uint32_t)i * DOVES_TRACK_DB_INDEX_ENTRY_SIZE, entry, sizeof(entry)) || readU32(entry) > lastKey) {
+      break;
+    }
+
+    int trackIndex = readU16(entry + 4);
+    uint8_t record[DOVES_TRACK_DB_TRACK_SIZE];
+    if (!readTrackRecord(trackIndex, record)) {
+      continue;
+    }
+    // equirectangular distance, plenty for comparing against a radius of a few km
+    double deltaLng = readDegrees(record + 4) - lng;
+    if (deltaLng > 180) {
+      deltaLng -= 360;
+    } else if (deltaLng < -180) {
+      deltaLng += 360;
+    }
+    double dy = (readDegrees(record) - lat) * metersPerDegree;
+    double dx = deltaLng * metersPerDegree * cos(radians(lat));
+    double distance = sqrt(dx * dx + dy * dy);
+    if (distance <= readU16(record + 8) && distance < bestDistance) {
+      bestDistance = distance;
+      bestTrack = trackIndex;
+    }
+  }
+}
+
+int DovesTrackDatabase::lowerBound(uint32_t key) {
+  int low = 0;
+  int high = trackCount;
+  while (low < high) {
+    int middle = low + (high - low) / 2;
+    uint8_t entry[4];
+    if (!read(indexOffset + (uint32_t)middle * DOVES_TRACK_DB_INDEX_ENTRY_SIZE, entry, sizeof(entry))) {
+      return trackCount;
+    }
+    if (readU32(entry) < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+bool DovesTrackDatabase::memoryReader(void *context, uint32_t offset, void *buffer, size_t length) {
+  DovesTrackDatabase *database = (DovesTrackDatabase *)context;
+  if (offset > database->memorySize || length > database->memorySize - offset) {
+    return false;
+  }
+  memcpy(buffer, database->memoryData + offset, length);
+  return true;
+}
@@ -0,0 +1,136 @@
+/**
+ * Compact binary database of venues, their layouts and timing lines, so sketches don't have to hard-code crossing points.
+ * The database can live in flash (memory-mapped) or on an SD card, it is only ever read a few bytes at a time.
+ * Build one from JSON with extras/trackdb/build_trackdb.py
+ *
+ * Format (little-endian, coordinates are int32 degrees * 1e7):
+ *   header  16 bytes: "DLTD", uint16 version, uint16 trackCount, uint32 indexOffset, uint32 trackOffset
+ *   index    8 bytes per track, sorted by cell key: uint32 cellKey, uint16 trackIndex, uint16 reserved
+ *   tracks  40 bytes per track: int32 lat, int32 lng, uint16 radiusMeters, uint8 layoutCount, uint8 reserved, uint32 layoutOffset, char name[24]
+ *   layouts 32 bytes per layout: char name[24], uint8 lineCount, uint8 reserved, uint16 reserved, uint32 lineOffset
+ *   lines   20 bytes per line: int32 aLat, int32 aLng, int32 bLat, int32 bLng, uint8 timingLineType, int8 crossingDirection, uint16 reserved
+ *
+ * The cell key packs a quarter degree grid cell as (latCell << 16) | lngCell, finding the track under a fix
+ * is a binary search for each of the 3 rows of cells around it, instead of a scan of every track.
+ */
+
+#ifndef _DOVES_TRACK_DATABASE_H
+#define _DOVES_TRACK_DATABASE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "DovesLapTimer.h"
+
+#define DOVES_TRACK_DB_VERSION 1
+#define DOVES_TRACK_DB_NAME_SIZE 24
+#define DOVES_TRACK_DB_CELLS_PER_DEGREE 4
+
+/**
+ * @brief Reads length bytes at offset of the database into buffer.
+ *
+ * @return True if every byte was read.
+ */
+typedef bool (*dovesTrackDbReader)(void *context, uint32_t offset, void *buffer, size_t length);
+
+struct dovesTrackInfo {
+  char name[DOVES_TRACK_DB_NAME_SIZE];
+  double centerLat;
+  double centerLng;
+  uint16_t radiusMeters; // fixes further than this from the center do not match the track, at most a grid cell wide
+  uint8_t layoutCount;
+};
+
+struct dovesLayoutInfo {
+  char name[DOVES_TRACK_DB_NAME_SIZE];
+  uint8_t lineCount;
+};
+
+class DovesTrackDatabase {
+public:
+  /**
+   * @brief Opens a database kept in memory-mapped flash or RAM.
+   *
+   * @param data Start of the database.
+   * @param size Size of the database in bytes.
+   * @return True if the header is valid.
+   */
+  bool begin(const uint8_t *data, uint32_t size);
+  /**
+   * @brief Opens a database through a custom reader, e.g. a file on an SD card.
+   *
+   * @param reader Function reading bytes out of the database.
+   * @param context Passed back to the reader, e.g. the open File.
+   * @return True if the header is valid.
+   */
+  bool begin(dovesTrackDbReader reader, void *context);
+  /**
+   * @brief Gets the number of tracks in the database.
+   *
+   * @return The number of tracks, 0 if no valid database is open.
+   */
+  int getTrackCount() const;
+  /**
+   * @brief Finds the track a position belongs to, usually called with the first fix.
+   *
+   * Only the tracks indexed in the grid cells around the position are looked at.
+   *
+   * @param lat Latitude of the position in decimal degrees.
+   * @param lng Longitude of the position in decimal degrees.
+   * @return The index of the closest track within its radius, or -1 if none.
+   */
+  int findTrack(double lat, double lng);
+  /**
+   * @brief Reads the details of a track.
+   *
+   * @param trackIndex Index of the track.
+   * @param info Reference to store the details in.
+   * @return True if the track exists.
+   */
+  bool getTrack(int trackIndex, dovesTrackInfo &info);
+  /**
+   * @brief Reads the details of a layout of a track.
+   *
+   * @param trackIndex Index of the track.
+   * @param layoutIndex Index of the layout within the track.
+   * @param info Reference to store the details in.
+   * @return True if the layout exists.
+   */
+  bool getLayout(int trackIndex, int layoutIndex, dovesLayoutInfo &info);
+  /**
+   * @brief Replaces every timing line of the lap timer with the ones of a layout.
+   *
+   * Remember to reset() the lap timer when switching layouts mid-session.
+   *
+   * @param trackIndex Index of the track.
+   * @param layoutIndex Index of the layout within the track.
+   * @param lapTimer Lap timer to register the lines with.
+   * @return The number of lines registered, or -1 if the layout does not exist or can't be read. The lap timer then keeps
+   *         the lines it had, or none if the reader fails while they are being replaced.
+   */
+  int loadLayout(int trackIndex, int layoutIndex, DovesLapTimer &lapTimer);
+
+private:
+  bool read(uint32_t offset, void *buffer, size_t length);
+  bool readTrackRecord(int trackIndex, uint8_t *record);
+  bool readLayoutRecord(int trackIndex, int layoutIndex, uint8_t *record);
+  /**
+   * @brief Looks at every track indexed in a run of cells of one row, keeping the closest one within its radius.
+   */
+  void searchCells(long row, long firstColumn, long lastColumn, double lat, double lng, int &bestTrack, double &bestDistance);
+  /**
+   * @brief Binary searches the index for the first entry with a cell key of at least key.
+   */
+  int lowerBound(uint32_t key);
+  static bool memoryReader(void *context, uint32_t offset, void *buffer, size_t length);
+
+  dovesTrackDbReader reader = nullptr;
+  void *readerContext = nullptr;
+  // only used by the memory reader
+  const uint8_t *memoryData = nullptr;
+  uint32_t memorySize = 0;
+
+  uint16_t trackCount = 0;
+  uint32_t indexOffset = 0;
+  uint32_t trackOffset = 0;
+};
+
+#endif